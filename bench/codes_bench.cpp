@@ -0,0 +1,184 @@
+/**
+ * Host benchmark: per-frame field extraction cost
+ *
+ * Compares the former String based decoding (linear equalsIgnoreCase scans
+ * over hex codes) with the mask + inverse table lookups from codes.h. Both
+ * paths have to decode every frame to the same fields, the bench fails on
+ * the first mismatch.
+ *
+ *   g++ -O2 -std=gnu++17 -Inative/hal -Iinclude bench/codes_bench.cpp -o codes_bench
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <strings.h>
+#include <vector>
+#include "codes.h"
+
+#define FRAMES      4096
+#define ITERATIONS  200
+
+struct Fields {
+  unsigned temperature, mode, speed, swing, timer;
+  bool airFlow, sleep, power, turbo, hold;
+};
+
+// Legacy path: hex strings passed by value, nibbles blanked, linear scans
+namespace legacy {
+  static std::string hex(uint16_t code) {
+    char buf[5];
+    snprintf(buf, sizeof(buf), "%04X", code);
+    return buf;
+  }
+
+  static bool eq(const std::string &a, uint16_t code) {
+    return strcasecmp(a.c_str(), hex(code).c_str()) == 0;
+  }
+
+  // The former code added 16 whenever the mode was HEAT_ALT, at any
+  // temperature, and missed 32C in cool and fan. Alternative mode codes are
+  // only sent with the 16C/32C code, so any of them marks 32C there.
+  static unsigned temperature(std::string param) {
+    std::string tempCode = param, modeCode = param;
+    tempCode[1] = tempCode[3] = '0';
+    modeCode[0] = modeCode[2] = '0';
+    bool alt = eq(modeCode, CHIGO_PARAM_MODE_COOL_ALT) || eq(modeCode, CHIGO_PARAM_MODE_HEAT_ALT) ||
+      eq(modeCode, CHIGO_PARAM_MODE_FAN_ALT);
+    for (int i = 0; i < 16; i++)
+      if (eq(tempCode, temperatures[i]))
+        return i == 0 && alt ? 32 : i + 16;
+    return 0;
+  }
+
+  static unsigned mode(std::string param) {
+    param[0] = param[2] = '0';
+    for (int i = 0; i < 8; i++)
+      if (eq(param, CHIGO_MODES[i]))
+        return CHIGO_MODE_VALUES[i] & CHIGO_MODE_VALUE;
+    return 0;
+  }
+
+  static unsigned speed(std::string param, bool &airFlow) {
+    param[0] = param[2] = '0';
+    for (int i = 0; i < 8; i++)
+      if (eq(param, CHIGO_SPEEDS[i])) {
+        airFlow = i >= 4;
+        return i & 3;
+      }
+    return 0;
+  }
+
+  static unsigned swing(std::string param, bool &sleep, bool &power) {
+    param[1] = param[3] = '0';
+    power = true;
+    for (int i = 0; i < 9; i++)
+      if (eq(param, CHIGO_SWINGS[i])) {
+        sleep = i >= 3 && i < 6;
+        power = i < 6;
+        return i % 3;
+      }
+    return 0;
+  }
+
+  static unsigned timer(std::string code) {
+    unsigned delay = 0;
+    for (int i = 0; i < 25; i++)
+      if (eq(code, newTimerDelays[i]) || eq(code, oldTimerDelays[i]))
+        delay = i;
+    return delay;
+  }
+
+  static void decode(const uint16_t *words, Fields &f) {
+    std::string timerCode = hex(words[0]), extra = hex(words[1]);
+    std::string param = hex(words[3]), tempMode = hex(words[4]);
+    f.timer = timer(timerCode);
+    f.turbo = eq(extra, CHIGO_EXTRA_TURBO) || eq(extra, CHIGO_EXTRA_TURBO_HOLD);
+    f.hold = eq(extra, CHIGO_EXTRA_HOLD) || eq(extra, CHIGO_EXTRA_TURBO_HOLD);
+    f.temperature = temperature(tempMode);
+    f.mode = mode(tempMode);
+    f.speed = speed(param, f.airFlow);
+    f.swing = swing(param, f.sleep, f.power);
+  }
+}
+
+// Table path: one mask and one table index per field
+namespace tables {
+  static void decode(const uint16_t *words, Fields &f) {
+    uint8_t delay = chigoLookup(timerDelayTable, words[0], CHIGO_MASK_TIMER_DELAY);
+    uint8_t kind = chigoLookup(timerKindTable, words[0], CHIGO_MASK_TIMER_KIND);
+    f.timer = (delay == CHIGO_INVALID || kind == CHIGO_INVALID) ? 0 : delay + ((kind & CHIGO_TIMER_16h) ? 16 : 0);
+    uint8_t extra = chigoLookup(extraTable, words[1], CHIGO_MASK_EXTRA);
+    f.turbo = extra != CHIGO_INVALID && (extra & CHIGO_EXTRA_TURBO_FLAG);
+    f.hold = extra != CHIGO_INVALID && (extra & CHIGO_EXTRA_HOLD_FLAG);
+    f.temperature = chigoLookup(temperatureTable, words[4], CHIGO_MASK_TEMP) + 16;
+    uint8_t mode = chigoLookup(modeTable, words[4], CHIGO_MASK_MODE);
+    if (mode != CHIGO_INVALID && (mode & CHIGO_MODE_ALT) && f.temperature == 16)
+      f.temperature = 32;
+    f.mode = mode & CHIGO_MODE_VALUE;
+    uint8_t speed = chigoLookup(speedTable, words[3], CHIGO_MASK_SPEED);
+    f.speed = speed & CHIGO_SPEED_VALUE;
+    f.airFlow = speed & CHIGO_SPEED_AIRFLOW;
+    uint8_t swing = chigoLookup(swingTable, words[3], CHIGO_MASK_SWING);
+    f.swing = swing & CHIGO_SWING_VALUE;
+    f.sleep = swing & CHIGO_SWING_SLEEP;
+    f.power = !(swing & CHIGO_SWING_POWEROFF);
+  }
+}
+
+template <typename Decode>
+static double run(const char *name, const std::vector<uint16_t> &frames, Decode decode) {
+  Fields f;
+  unsigned checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int it = 0; it < ITERATIONS; it++)
+    for (size_t i = 0; i < frames.size(); i += 6) {
+      decode(&frames[i], f);
+      checksum += f.temperature + f.mode + f.speed + f.swing + f.timer + f.power;
+    }
+  auto end = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(end - start).count() / (ITERATIONS * (frames.size() / 6));
+  printf("%-8s %10.1f ns/frame (checksum %u)\n", name, ns, checksum);
+  return ns;
+}
+
+static bool sameFields(const Fields &a, const Fields &b) {
+  return a.temperature == b.temperature && a.mode == b.mode && a.speed == b.speed &&
+    a.swing == b.swing && a.timer == b.timer && a.airFlow == b.airFlow && a.sleep == b.sleep &&
+    a.power == b.power && a.turbo == b.turbo && a.hold == b.hold;
+}
+
+int main() {
+  std::vector<uint16_t> frames;
+  uint32_t seed = 1;
+  for (int i = 0; i < FRAMES; i++) {
+    seed = seed * 1103515245 + 12345;
+    unsigned r = seed >> 8;
+    uint16_t param = (CHIGO_SWINGS[r % 9] & CHIGO_MASK_SWING) | (CHIGO_SPEEDS[(r >> 4) % 8] & CHIGO_MASK_SPEED);
+    uint16_t tempMode = (temperatures[(r >> 8) % 16] & CHIGO_MASK_TEMP) | (CHIGO_MODES[(r >> 12) % 8] & CHIGO_MASK_MODE);
+    uint16_t timer = (r >> 16) % 2 ? CHIGO_TIMER_SKIP : newTimerDelays[(r >> 17) % 25];
+    uint16_t words[6] = {timer, CHIGO_EXTRAS[(r >> 22) % 4], CHIGO_CMD_POWER, param, tempMode, CHIGO_FOOTER};
+    frames.insert(frames.end(), words, words + 6);
+  }
+
+  for (size_t i = 0; i < frames.size(); i += 6) {
+    Fields expected = {}, actual = {};
+    legacy::decode(&frames[i], expected);
+    tables::decode(&frames[i], actual);
+    if (!sameFields(expected, actual)) {
+      printf("mismatch in frame %zu: %04X %04X %04X %04X %04X %04X\n", i / 6,
+        frames[i], frames[i + 1], frames[i + 2], frames[i + 3], frames[i + 4], frames[i + 5]);
+      printf("  strings: temp %u mode %u speed %u swing %u timer %u\n",
+        expected.temperature, expected.mode, expected.speed, expected.swing, expected.timer);
+      printf("  tables:  temp %u mode %u speed %u swing %u timer %u\n",
+        actual.temperature, actual.mode, actual.speed, actual.swing, actual.timer);
+      return 1;
+    }
+  }
+  printf("%d frames: both paths decode the same fields\n", FRAMES);
+
+  double before = run("strings", frames, legacy::decode);
+  double after = run("tables", frames, tables::decode);
+  printf("speedup  %10.1fx\n", before / after);
+  return 0;
+}
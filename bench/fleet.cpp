@@ -0,0 +1,432 @@
+/**
+ * Host fleet simulator: N adapters against a local MQTT broker
+ *
+ * Every adapter is a forked process running the real sketch (setup(),
+ * loop(), callback()) against the shims in native/hal, with the journal in
+ * a RAM flash image and remote presses fed into the IR receiver. The parent
+ * drives the workload over its own MQTT session and measures what comes
+ * back on the get topics.
+ *
+ * Scenarios:
+ *   set     temperature set commands, set -> temperature/get latency
+ *   remote  remote presses (fan speed), press -> fan/get latency
+ *   mixed   both at once
+ *   storm   every adapter loses its session at the same time, time until
+ *           all of them are back (handshake) and republished their state
+ *
+ *   pio run -e fleet && .pio/build/fleet/program [options]
+ * or
+ *   g++ -O2 -std=gnu++17 -DJOURNAL_FIRST_SECTOR=0 -Inative/hal -Iinclude bench/fleet.cpp -o fleet
+ *
+ * Options: -n adapters (20), -d seconds per scenario (10), -r sets/s over
+ * the fleet (50), -k presses/s per adapter (0.5), -b broker host
+ * (127.0.0.1), -p port (1883), -s scenario (all).
+ */
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <string>
+#include <sys/wait.h>
+#include <vector>
+
+#include "../src/ac-ir-mqtt-zhjt03.ino"
+
+#define TOPIC_ROOT "fleet"
+#define TICK_US 1000            // adapter loop period
+#define SETTLE_MS 500           // after the fleet is up, before measuring
+#define DRAIN_MS 1000           // after the workload, for answers in flight
+#define STORM_INTERVAL_MS 3000  // between session drops (storm)
+
+struct Options {
+  unsigned adapters = 20;
+  unsigned seconds = 10;
+  double setRate = 50;
+  double pressRate = 0.5;
+  const char *host = "127.0.0.1";
+  uint16_t port = 1883;
+  const char *scenario = "all";
+};
+
+/**
+ * Remote press as reported by an adapter over the event pipe
+ */
+struct PressEvent {
+  uint32_t adapter;
+  uint32_t speed;
+  unsigned long at;   // micros()
+};
+
+struct Pending {
+  int value = -1;
+  unsigned long at = 0;
+};
+
+static volatile sig_atomic_t dropRequested = 0;
+static volatile sig_atomic_t stopRequested = 0;
+
+static double exponential(double rate) {
+  double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+  return -log(u) / rate;
+}
+
+static double percentile(std::vector<double> &samples, double p) {
+  if (samples.empty())
+    return 0;
+  std::sort(samples.begin(), samples.end());
+  size_t i = (size_t)ceil(p * samples.size()) - 1;
+  return samples[std::min(i, samples.size() - 1)];
+}
+
+struct HvacFleet {
+  Options options;
+  std::string scenario;
+  std::vector<pid_t> children;
+  int events[2] = {-1, -1};
+
+  // Parent side
+  WiFiClient driverNet;
+  PubSubClient driver;
+  std::vector<Pending> pendingSets, pendingPresses;
+  std::vector<int> lastSet;
+  std::vector<unsigned long> forkedAt, droppedAt;
+  std::vector<double> setLatency, pressLatency, connectLatency, stormLatency;
+  unsigned long sets = 0, presses = 0, messages = 0, superseded = 0, handshakes = 0;
+  static HvacFleet *instance;
+
+  bool runs(const char *name) {
+    return strcmp(options.scenario, "all") == 0 || strcmp(options.scenario, name) == 0;
+  }
+
+  std::string prefix(unsigned adapter) {
+    return std::string(TOPIC_ROOT "/") + scenario + "/" + std::to_string(adapter);
+  }
+
+  /**
+   * Adapter process: the sketch, plus remote presses at pressRate
+   */
+  void adapter(unsigned index, double pressRate) {
+    static char id[32], topic[48], handshake[64];
+    snprintf(id, sizeof(id), "fleet-%s-%u", scenario.c_str(), index);
+    snprintf(topic, sizeof(topic), "%s", prefix(index).c_str());
+    snprintf(handshake, sizeof(handshake), "%s/handshake", topic);
+    clientID = id;
+    unit_topics[0] = topic;
+    topic_handshake = handshake;
+    mqtt_server = options.host;
+    nativeMqttPort = options.port;
+    Serial.enabled = false;
+    srand(getpid());
+
+    setup();
+
+    unsigned long nextPress = 0;
+    while (!stopRequested && getppid() != 1) {
+      if (dropRequested) {
+        dropRequested = 0;
+        client.drop();
+      }
+
+      unsigned long now = millis();
+      if (pressRate > 0 && connection.isConnected()) {
+        if (!nextPress)
+          nextPress = now + exponential(pressRate) * 1000;
+        else if ((long)(now - nextPress) >= 0) {
+          press(index);
+          nextPress += exponential(pressRate) * 1000;
+        }
+      }
+
+      loop();
+      usleep(TICK_US);
+    }
+    client.disconnect();
+    _exit(0);
+  }
+
+  /**
+   * Feed a remote frame (next fan speed, rest of the state kept) into the
+   * receiver, edge by edge as the interrupt would
+   */
+  void press(unsigned index) {
+    HvacController<HvacProtocol> remote;
+    remote.state = hvac[RECV_UNIT].state;
+    remote.state.setPower(true);
+    remote.state.setAirSpeed(static_cast<Speed>((remote.state.airSpeed() + 1) % 4));
+
+    List raw;
+    encodeFrame(remote.buildFrame(HvacProtocol::CMD_SPEED), raw);
+    PressEvent event = {index, remote.state.airSpeed(), micros()};
+    if (write(events[1], &event, sizeof(event)) != sizeof(event))
+      return;
+
+    receiver.feed(100000, false);
+    for (uint16_t i = 0; i < raw.counter; i++)
+      receiver.feed(raw.data[i], (i & 1) == 0);
+  }
+
+  /**
+   * Parent side: match get messages with pending sets and presses
+   */
+  static void onMessage(char *topic, uint8_t *payload, unsigned int length) {
+    instance->message(topic, payload, length);
+  }
+
+  void message(const char *topic, const uint8_t *payload, unsigned length) {
+    std::string root = std::string(TOPIC_ROOT "/") + scenario + "/";
+    if (strncmp(topic, root.c_str(), root.size()) != 0)
+      return;
+    char *field;
+    unsigned long adapter = strtoul(topic + root.size(), &field, 10);
+    if (adapter >= options.adapters || *field != '/')
+      return;
+
+    unsigned long now = micros();
+    std::string value((const char *)payload, length);
+    messages++;
+
+    if (strcmp(field, "/handshake") == 0) {
+      handshakes++;
+      if (forkedAt[adapter]) {
+        connectLatency.push_back((now - forkedAt[adapter]) / 1000.0);
+        forkedAt[adapter] = 0;
+      }
+      if (droppedAt[adapter]) {
+        stormLatency.push_back((now - droppedAt[adapter]) / 1000.0);
+        droppedAt[adapter] = 0;
+      }
+    }
+    else if (strcmp(field, TOPIC_TEMPERATURE_GET) == 0) {
+      Pending &pending = pendingSets[adapter];
+      if (pending.value >= 0 && atoi(value.c_str()) == pending.value) {
+        setLatency.push_back((now - pending.at) / 1000.0);
+        pending.value = -1;
+      }
+    }
+    else if (strcmp(field, TOPIC_FAN_GET) == 0) {
+      Pending &pending = pendingPresses[adapter];
+      if (pending.value >= 0 && value == fan_modes[pending.value]) {
+        pressLatency.push_back((now - pending.at) / 1000.0);
+        pending.value = -1;
+      }
+    }
+  }
+
+  void readEvents() {
+    PressEvent event;
+    while (read(events[0], &event, sizeof(event)) == sizeof(event)) {
+      presses++;
+      Pending &pending = pendingPresses[event.adapter];
+      if (pending.value >= 0)
+        superseded++;
+      pending.value = event.speed;
+      pending.at = event.at;
+    }
+  }
+
+  void sendSet() {
+    unsigned adapter = rand() % options.adapters;
+    int value;
+    do {
+      value = HvacProtocol::TEMP_MIN + rand() % (HvacProtocol::TEMP_MAX - HvacProtocol::TEMP_MIN + 1);
+    } while (value == lastSet[adapter]);
+    lastSet[adapter] = value;
+
+    Pending &pending = pendingSets[adapter];
+    if (pending.value >= 0)
+      superseded++;
+    pending.value = value;
+    pending.at = micros();
+
+    char payload[4];
+    snprintf(payload, sizeof(payload), "%d", value);
+    driver.publish((prefix(adapter) + TOPIC_TEMPERATURE_SET).c_str(), payload);
+    sets++;
+  }
+
+  void service(unsigned long ms) {
+    unsigned long end = millis() + ms;
+    while ((long)(millis() - end) < 0) {
+      readEvents();
+      driver.loop();
+      usleep(200);
+    }
+  }
+
+  bool start(double pressRate) {
+    unsigned n = options.adapters;
+    pendingSets.assign(n, Pending());
+    pendingPresses.assign(n, Pending());
+    lastSet.assign(n, HvacState().temperature());
+    forkedAt.assign(n, 0);
+    droppedAt.assign(n, 0);
+    setLatency.clear();
+    pressLatency.clear();
+    connectLatency.clear();
+    stormLatency.clear();
+    sets = presses = messages = superseded = handshakes = 0;
+
+    if (pipe(events) != 0)
+      return false;
+    fcntl(events[0], F_SETFL, O_NONBLOCK);
+
+    char id[32];
+    snprintf(id, sizeof(id), "fleet-driver-%d", getpid());
+    driver.setServer(options.host, options.port);
+    driver.setCallback(onMessage);
+    if (!driver.connect(id)) {
+      fprintf(stderr, "cannot connect to %s:%u (rc=%d)\n", options.host, options.port, driver.state());
+      return false;
+    }
+    std::string root = std::string(TOPIC_ROOT "/") + scenario;
+    driver.subscribe((root + "/+/handshake").c_str());
+    driver.subscribe((root + "/+" TOPIC_TEMPERATURE_GET).c_str());
+    driver.subscribe((root + "/+" TOPIC_FAN_GET).c_str());
+    service(100);
+
+    for (unsigned i = 0; i < n; i++) {
+      forkedAt[i] = micros();
+      pid_t pid = fork();
+      if (pid == 0) {
+        driver.drop();
+        close(events[0]);
+        adapter(i, pressRate);
+      }
+      children.push_back(pid);
+    }
+    close(events[1]);
+
+    // Wait for the fleet to come up
+    unsigned long deadline = millis() + 10000 + n * 50;
+    while (connectLatency.size() < n && (long)(millis() - deadline) < 0)
+      service(10);
+    if (connectLatency.size() < n)
+      fprintf(stderr, "only %zu of %u adapters connected\n", connectLatency.size(), n);
+    service(SETTLE_MS);
+
+    // Measure the workload only
+    sets = presses = messages = superseded = 0;
+    pendingSets.assign(n, Pending());
+    pendingPresses.assign(n, Pending());
+    setLatency.clear();
+    pressLatency.clear();
+    return true;
+  }
+
+  void stop() {
+    for (pid_t pid : children)
+      kill(pid, SIGTERM);
+    for (pid_t pid : children)
+      waitpid(pid, NULL, 0);
+    children.clear();
+    close(events[0]);
+    driver.disconnect();
+  }
+
+  void run(const char *name, double setRate, double pressRate, bool storm) {
+    scenario = name;
+    if (!start(pressRate)) {
+      stop();
+      return;
+    }
+    std::vector<double> connect = connectLatency;
+
+    unsigned long begin = millis();
+    unsigned long end = begin + options.seconds * 1000UL;
+    unsigned long nextSet = begin;
+    unsigned long nextStorm = begin;
+    unsigned storms = 0;
+    while ((long)(millis() - end) < 0) {
+      unsigned long now = millis();
+      if (setRate > 0 && (long)(now - nextSet) >= 0) {
+        sendSet();
+        nextSet += std::max(1.0, exponential(setRate) * 1000);
+      }
+      if (storm && (long)(now - nextStorm) >= 0) {
+        for (unsigned i = 0; i < options.adapters; i++) {
+          droppedAt[i] = micros();
+          kill(children[i], SIGUSR1);
+        }
+        storms++;
+        nextStorm += STORM_INTERVAL_MS;
+      }
+      service(1);
+    }
+    service(DRAIN_MS);
+    double seconds = (millis() - begin) / 1000.0;
+    stop();
+
+    printf("[%s] %u adapters, %.1f s\n", name, options.adapters, seconds);
+    printf("  connect:   p50 %7.1f ms  p99 %7.1f ms  (%zu of %u)\n",
+      percentile(connect, 0.5), percentile(connect, 0.99), connect.size(), options.adapters);
+    printf("  messages:  %lu in (%.1f/s)\n", messages, messages / seconds);
+    if (setRate > 0) {
+      size_t lost = sets - setLatency.size();
+      printf("  set->get:  p50 %7.1f ms  p99 %7.1f ms  (%lu sets, %.1f/s, %zu unanswered)\n",
+        percentile(setLatency, 0.5), percentile(setLatency, 0.99), sets, sets / seconds, lost);
+    }
+    if (pressRate > 0) {
+      size_t lost = presses - pressLatency.size();
+      printf("  press->get: p50 %6.1f ms  p99 %7.1f ms  (%lu presses, %.1f/s, %zu unanswered)\n",
+        percentile(pressLatency, 0.5), percentile(pressLatency, 0.99), presses, presses / seconds, lost);
+    }
+    if (storm) {
+      printf("  reconnect: p50 %7.1f ms  p99 %7.1f ms  (%u storms, %zu of %u sessions back)\n",
+        percentile(stormLatency, 0.5), percentile(stormLatency, 0.99), storms, stormLatency.size(),
+        storms * options.adapters);
+    }
+    if (superseded)
+      printf("  %lu requests superseded before an answer\n", superseded);
+  }
+};
+
+HvacFleet *HvacFleet::instance = NULL;
+
+int main(int argc, char **argv) {
+  HvacFleet fleet;
+  HvacFleet::instance = &fleet;
+  Options &options = fleet.options;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const char *value = argv[i + 1];
+    if (strcmp(argv[i], "-n") == 0)
+      options.adapters = atoi(value);
+    else if (strcmp(argv[i], "-d") == 0)
+      options.seconds = atoi(value);
+    else if (strcmp(argv[i], "-r") == 0)
+      options.setRate = atof(value);
+    else if (strcmp(argv[i], "-k") == 0)
+      options.pressRate = atof(value);
+    else if (strcmp(argv[i], "-b") == 0)
+      options.host = value;
+    else if (strcmp(argv[i], "-p") == 0)
+      options.port = atoi(value);
+    else if (strcmp(argv[i], "-s") == 0)
+      options.scenario = value;
+    else {
+      fprintf(stderr, "usage: %s [-n adapters] [-d seconds] [-r sets/s] [-k presses/s] "
+        "[-b host] [-p port] [-s set|remote|mixed|storm|all]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (options.adapters == 0)
+    return 2;
+
+  signal(SIGUSR1, [](int) { dropRequested = 1; });
+  signal(SIGTERM, [](int) { stopRequested = 1; });
+  signal(SIGPIPE, SIG_IGN);
+  Serial.enabled = false;
+  srand(1);
+
+  if (fleet.runs("set"))
+    fleet.run("set", options.setRate, 0, false);
+  if (fleet.runs("remote"))
+    fleet.run("remote", 0, options.pressRate, false);
+  if (fleet.runs("mixed"))
+    fleet.run("mixed", options.setRate, options.pressRate, false);
+  if (fleet.runs("storm"))
+    fleet.run("storm", 0, 0, true);
+  return 0;
+}
@@ -0,0 +1,132 @@
+/**
+ * Host benchmark: controller hot paths
+ *
+ * Builds the whole sketch against the shims in native/hal and times the
+ * receive path (verifyIRData, decodeIRData, receiveCommand), the send path
+ * (frame building, sendCommand through the transmitter) and MQTT callback
+ * dispatch.
+ * Reports ns/op and heap allocations/op.
+ *
+ *   pio run -e native && .pio/build/native/program
+ * or
+ *   g++ -O2 -std=gnu++17 -DJOURNAL_FIRST_SECTOR=0 -Inative/hal -Iinclude bench/hvac_bench.cpp -o hvac_bench
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#define ITERATIONS 200000
+
+/**
+ * Allocation counting
+ */
+static unsigned long allocations = 0;
+
+void *operator new(size_t size) {
+  allocations++;
+  if (void *p = malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+#include "../src/ac-ir-mqtt-zhjt03.ino"
+
+static volatile unsigned long sink;
+
+struct HvacBench {
+  HvacController<HvacProtocol> controller;
+  decode_results capture;
+  uint16_t rawbuf[RAW_FRAME_LENGTH + 1];
+  Frame frame;
+
+  HvacBench() {
+    transmitter.attach(0, SEND_PIN);
+
+    // A capture of a full frame as the receiver would report it
+    List raw;
+    controller.state.setPower(true);
+    encodeFrame(controller.buildFrame(HvacProtocol::CMD_POWER), raw);
+    rawbuf[0] = 0xFFFF;
+    for (uint16_t i = 0; i < raw.counter; i++)
+      rawbuf[i + 1] = raw.data[i] / RAWTICK;
+    capture.rawbuf = rawbuf;
+    capture.rawlen = raw.counter + 1;
+    controller.decodeIRData(&capture, frame);
+  }
+
+  template<typename F> void measure(const char *name, F operation) {
+    for (int i = 0; i < ITERATIONS / 100; i++)
+      operation(i);
+
+    unsigned long allocationsBefore = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++)
+      operation(i);
+    auto end = std::chrono::steady_clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / ITERATIONS;
+    double allocs = (double)(allocations - allocationsBefore) / ITERATIONS;
+    printf("%-24s %10.1f ns/op %8.2f allocs/op\n", name, ns, allocs);
+  }
+
+  void run() {
+    measure("verifyIRData", [&](int) {
+      sink = controller.verifyIRData(&capture, frame);
+    });
+
+    measure("decodeIRData", [&](int) {
+      Frame decoded;
+      sink = controller.decodeIRData(&capture, decoded);
+      sink = decoded.tempMode;
+    });
+
+    measure("receiveCommand", [&](int) {
+      controller.receiveCommand(frame);
+      sink = controller.state.bits;
+    });
+
+    measure("buildFrame+encodeFrame", [&](int i) {
+      List raw;
+      controller.state.setTemperature(HvacProtocol::TEMP_MIN + i % 17);
+      encodeFrame(controller.buildFrame(HvacProtocol::CMD_TEMP_UP), raw);
+      sink = raw.counter;
+    });
+
+    measure("sendCommand+transmit", [&](int i) {
+      controller.state.setTemperature(HvacProtocol::TEMP_MIN + i % 2);
+      controller.sendCommand(HvacProtocol::CMD_TEMP_UP);
+      transmitter.loop();
+      transmitter.loop();
+    });
+
+    char subscribe[MAX_TOPIC_LENGTH];
+    char topic[MAX_TOPIC_LENGTH];
+    uint8_t payload[] = "24";
+    strcpy(subscribe, router.topic(0, TOPIC_TEMPERATURE_SET));
+    measure("callback", [&](int) {
+      strcpy(topic, subscribe);
+      callback(topic, payload, 2);
+    });
+  }
+};
+
+int main() {
+  Serial.enabled = false;
+  router.begin(unit_topics, HVAC_UNITS);
+
+  printf("%d iterations\n", ITERATIONS);
+  HvacBench bench;
+  bench.run();
+  printf("frame cache: %u hits, %u misses\n", frameCache.hits, frameCache.misses);
+  return 0;
+}
@@ -0,0 +1,229 @@
+/**
+ * Host replay: IR capture corpus through the receive path
+ *
+ * Loads corpus files (see include/corpus.h, serial logs of an IR_RECORDER
+ * build work as is), checks every capture against its state label and
+ * against the echo/repeat filter (only a frame identical to an earlier one
+ * may be suppressed) and then replays the whole corpus through
+ * verifyIRData, decodeIRData and receiveCommand for throughput.
+ *
+ *   pio run -e replay && .pio/build/replay/program [-n passes] corpus/sample.irc
+ * or
+ *   g++ -O2 -std=gnu++17 -DJOURNAL_FIRST_SECTOR=0 -Inative/hal -Iinclude bench/replay.cpp -o replay
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../src/ac-ir-mqtt-zhjt03.ino"
+
+#define DEFAULT_PASSES 100
+
+struct Capture {
+  std::string source; // file:line
+  std::vector<uint16_t> rawbuf;
+  HvacState expected;
+  ChangeMask labelled = 0;
+  bool reset = false;   // first capture of a file: start from the default state
+};
+
+static volatile unsigned long sink;
+
+struct HvacReplay {
+  std::vector<Capture> corpus;
+  unsigned long accepted = 0;
+  unsigned long incomplete = 0;
+  unsigned long invalid = 0;
+  unsigned long checked = 0;
+  unsigned long mismatches = 0;
+  unsigned long suppressed = 0;        // repeats of an earlier frame
+  unsigned long wronglySuppressed = 0; // distinct frames taken for repeats
+  SpaceClassifier classifier;   // receiver statistics of the checked pass
+
+  bool load(const char *path) {
+    std::ifstream file(path);
+    if (!file) {
+      fprintf(stderr, "%s: cannot open\n", path);
+      return false;
+    }
+
+    std::string line;
+    size_t first = corpus.size();
+    for (unsigned number = 1; std::getline(file, line); number++) {
+      // Serial logs: only recorder lines count
+      size_t prefix = line.find(CORPUS_PREFIX);
+      if (prefix != std::string::npos)
+        line.erase(0, prefix + strlen(CORPUS_PREFIX));
+      if (line.size() < 2 || line[1] != ' ')
+        continue;
+
+      std::string source = std::string(path) + ":" + std::to_string(number);
+      if (line[0] == 'C') {
+        Capture capture;
+        capture.source = source;
+        capture.rawbuf.push_back(0xFFFF); // gap before the frame
+        const char *text = line.c_str() + 2;
+        char *end;
+        for (unsigned long us = strtoul(text, &end, 10); end != text; us = strtoul(text, &end, 10)) {
+          capture.rawbuf.push_back(us / RAWTICK);
+          text = end;
+        }
+        capture.reset = corpus.size() == first;
+        corpus.push_back(capture);
+      }
+      else if (line[0] == 'S') {
+        if (corpus.empty() || !parseStateLabel(line.c_str() + 2, corpus.back().expected, corpus.back().labelled)) {
+          fprintf(stderr, "%s: bad state label\n", source.c_str());
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  static decode_results results(Capture &capture) {
+    decode_results results;
+    results.rawbuf = capture.rawbuf.data();
+    results.rawlen = capture.rawbuf.size();
+    results.overflow = false;
+    return results;
+  }
+
+  /**
+   * One pass with accounting and label checks
+   * Captures are replayed in order on one controller, like on the device.
+   */
+  void check() {
+    HvacController<HvacProtocol> controller;
+    FrameFilter filter;
+    std::vector<Frame> seen;
+    for (Capture &capture : corpus) {
+      if (capture.reset) {
+        controller.state = HvacState();
+        filter = FrameFilter();
+        seen.clear();
+      }
+      decode_results raw = results(capture);
+      Frame frame;
+      if (!controller.decodeIRData(&raw, frame)) {
+        incomplete++;
+        continue;
+      }
+      if (!controller.verifyIRData(&raw, frame)) {
+        invalid++;
+        continue;
+      }
+      accepted++;
+      checkFilter(filter, seen, frame, capture);
+      controller.receiveCommand(frame);
+
+      if (!capture.labelled)
+        continue;
+      checked++;
+      ChangeMask changes = diffState(controller.state, capture.expected) & capture.labelled;
+      if (!changes)
+        continue;
+
+      mismatches++;
+      printf("%s: mismatch", capture.source.c_str());
+      for (uint8_t i = 0; i < CORPUS_FIELDS; i++) {
+        const CorpusField &field = corpusFields[i];
+        if (changes & STATE_MASK(field.shift, field.width))
+          printf(" %s=%u (expected %u)", field.name,
+            (unsigned)((controller.state.bits >> field.shift) & ((1UL << field.width) - 1)),
+            (unsigned)((capture.expected.bits >> field.shift) & ((1UL << field.width) - 1)));
+      }
+      printf("\n");
+    }
+    classifier = controller.classifier;
+  }
+
+  /**
+   * The whole file is within the filter windows, so every frame identical
+   * to an earlier one counts as a repeat and no other frame may
+   */
+  void checkFilter(FrameFilter &filter, std::vector<Frame> &seen, const Frame &frame, const Capture &capture) {
+    uint8_t bytes[FRAME_BYTES];
+    uint8_t other[FRAME_BYTES];
+    frameToBytes(frame, bytes);
+    bool repeat = false;
+    for (const Frame &earlier : seen) {
+      frameToBytes(earlier, other);
+      repeat = repeat || memcmp(bytes, other, FRAME_BYTES) == 0;
+    }
+    seen.push_back(frame);
+
+    if (!filter.suppress(frameFingerprint(frame)))
+      return;
+    if (repeat) {
+      suppressed++;
+      return;
+    }
+    wronglySuppressed++;
+    printf("%s: distinct frame suppressed as a repeat\n", capture.source.c_str());
+  }
+
+  /**
+   * Timed passes without accounting
+   */
+  double replay(unsigned passes) {
+    HvacController<HvacProtocol> controller;
+    std::vector<decode_results> raw;
+    for (Capture &capture : corpus)
+      raw.push_back(results(capture));
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned pass = 0; pass < passes; pass++) {
+      for (size_t i = 0; i < raw.size(); i++) {
+        if (corpus[i].reset)
+          controller.state = HvacState();
+        Frame frame;
+        if (controller.decodeIRData(&raw[i], frame) && controller.verifyIRData(&raw[i], frame))
+          controller.receiveCommand(frame);
+      }
+      sink = controller.state.bits;
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count();
+  }
+};
+
+int main(int argc, char **argv) {
+  unsigned passes = DEFAULT_PASSES;
+  HvacReplay replay;
+  Serial.enabled = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+      passes = atoi(argv[++i]);
+    else if (!replay.load(argv[i]))
+      return 2;
+  }
+
+  if (replay.corpus.empty()) {
+    fprintf(stderr, "usage: %s [-n passes] corpus...\n", argv[0]);
+    return 2;
+  }
+
+  size_t total = replay.corpus.size();
+  replay.check();
+  printf("%zu captures: %lu accepted (%.1f%%), %lu incomplete, %lu invalid\n",
+    total, replay.accepted, 100.0 * replay.accepted / total, replay.incomplete, replay.invalid);
+  printf("%lu labelled: %lu mismatches\n", replay.checked, replay.mismatches);
+  printf("filter: %lu repeats suppressed, %lu distinct frames suppressed\n", replay.suppressed, replay.wronglySuppressed);
+
+  const SpaceClassifier &classifier = replay.classifier;
+  printf("spaces: %u/%u us average, confidence %u%% average, %u%% min, %lu weak, %lu fallbacks\n",
+    classifier.shortAverage, classifier.longAverage, classifier.confidenceAverage, classifier.confidenceMin,
+    (unsigned long)classifier.weakFrames, (unsigned long)classifier.fallbacks);
+
+  if (passes > 0) {
+    double ns = replay.replay(passes) / ((double)passes * total);
+    printf("%u passes: %.1f ns/capture, %.0f captures/s\n", passes, ns, 1e9 / ns);
+  }
+
+  return replay.mismatches || replay.wronglySuppressed ? 1 : 0;
+}
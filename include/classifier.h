@@ -0,0 +1,134 @@
+#include <IRrecv.h>
+
+// Split between short and long spaces (us) for frames without two clusters
+#ifndef SPACE_THRESHOLD_US
+#define SPACE_THRESHOLD_US 1000
+#endif
+
+// Spaces spread over less than this (us) are a single cluster
+#ifndef SPACE_MIN_SPREAD_US
+#define SPACE_MIN_SPREAD_US 300
+#endif
+
+// Frames classified with less confidence are counted as weak (%)
+#ifndef WEAK_CONFIDENCE
+#define WEAK_CONFIDENCE 25
+#endif
+
+struct SpaceClusters {
+  uint16_t threshold;
+  uint16_t shortMean;
+  uint16_t longMean;
+  uint8_t confidence;   // gap between the clusters relative to their distance (%)
+};
+
+/**
+ * Adaptive mark/space classifier
+ *
+ * Finds the short (0) and long (1) space clusters from the frame's own
+ * timings with one 2-means step seeded from the range midpoint, so frames
+ * from a drifting receiver are split where their clusters actually are.
+ * Integer only, no heap: one read of the capture (with the range) and a
+ * classify/pack pass, plus a repack in the rare case the refined split
+ * moves a space to the other cluster.
+ *
+ * Running statistics (EWMA over frames) describe the receiver.
+ */
+class SpaceClassifier {
+
+  public: uint32_t frames = 0;
+  public: uint32_t weakFrames = 0;
+  public: uint32_t fallbacks = 0;
+  public: uint16_t shortAverage = HvacProtocol::ZERO_SPACE;
+  public: uint16_t longAverage = HvacProtocol::ONE_SPACE;
+  public: uint8_t confidenceAverage = 100;
+  public: uint8_t confidenceMin = 100;
+
+  /**
+   * Classify count spaces, every second entry of rawbuf from index first,
+   * and pack them into 16-bit words (MSB first)
+   */
+  public: SpaceClusters decode(const volatile uint16_t *rawbuf, uint16_t first, uint8_t count, uint16_t *words) {
+    SpaceClusters clusters = {SPACE_THRESHOLD_US, HvacProtocol::ZERO_SPACE, HvacProtocol::ONE_SPACE, 0};
+    uint16_t spaces[FRAME_BITS];
+    uint16_t low = 0xFFFF;
+    uint16_t high = 0;
+
+    // Single read of the capture buffer, range on the way
+    for (uint8_t i = 0; i < count; i++) {
+      uint16_t ticks = rawbuf[first + 2 * i];
+      spaces[i] = ticks;
+      if (ticks < low)
+        low = ticks;
+      if (ticks > high)
+        high = ticks;
+    }
+
+    frames++;
+    if (low > high || (uint32_t)(high - low) * RAWTICK < SPACE_MIN_SPREAD_US) {
+      fallbacks++;
+      weakFrames++;
+      pack(spaces, count, SPACE_THRESHOLD_US / RAWTICK, words);
+      return clusters;
+    }
+
+    // Split at the midpoint and pack in the same pass
+    uint16_t split = ((uint32_t)low + high) / 2;
+    uint32_t shortSum = 0, longSum = 0;
+    uint8_t longCount = 0;
+    uint16_t shortMax = 0, longMin = 0xFFFF;
+    uint16_t word = 0;
+
+    for (uint8_t i = 0; i < count; i++) {
+      uint16_t ticks = spaces[i];
+      bool one = ticks > split;
+      if (one) {
+        longSum += ticks;
+        longCount++;
+        if (ticks < longMin)
+          longMin = ticks;
+      }
+      else {
+        shortSum += ticks;
+        if (ticks > shortMax)
+          shortMax = ticks;
+      }
+      word = (word << 1) | one;
+      if ((i & 15) == 15)
+        words[i >> 4] = word;
+    }
+
+    // One 2-means step: split halfway between the cluster means
+    uint16_t shortMean = shortSum / (count - longCount);
+    uint16_t longMean = longSum / longCount;
+    uint16_t threshold = ((uint32_t)shortMean + longMean) / 2;
+    clusters.shortMean = shortMean * RAWTICK;
+    clusters.longMean = longMean * RAWTICK;
+    clusters.threshold = threshold * RAWTICK;
+    clusters.confidence = longMin > shortMax ? (uint32_t)(longMin - shortMax) * 100 / (longMean - shortMean) : 0;
+
+    // Repack only if the new split moves a space to the other cluster
+    if (threshold < shortMax || threshold >= longMin)
+      pack(spaces, count, threshold, words);
+
+    // Running statistics (1/8 weight per frame)
+    shortAverage += ((int32_t)clusters.shortMean - shortAverage) / 8;
+    longAverage += ((int32_t)clusters.longMean - longAverage) / 8;
+    confidenceAverage += ((int16_t)clusters.confidence - confidenceAverage) / 8;
+    if (clusters.confidence < confidenceMin)
+      confidenceMin = clusters.confidence;
+    if (clusters.confidence < WEAK_CONFIDENCE)
+      weakFrames++;
+
+    return clusters;
+  }
+
+  private: static void pack(const uint16_t *spaces, uint8_t count, uint16_t threshold, uint16_t *words) {
+    uint16_t word = 0;
+    for (uint8_t i = 0; i < count; i++) {
+      word = (word << 1) | (spaces[i] > threshold);
+      if ((i & 15) == 15)
+        words[i >> 4] = word;
+    }
+  }
+};
@@ -1,128 +1,335 @@
+#include <Arduino.h>
+
 // Meta
-#define CHIGO_HEADER              "FF00FF00"
-#define CHIGO_FOOTER              "54AB"
+constexpr uint32_t CHIGO_HEADER                 = 0xFF00FF00;
+constexpr uint16_t CHIGO_FOOTER                 = 0x54AB;
+
+// Timings (usecs)
+constexpr uint16_t CHIGO_HEADER_MARK            = 6234;
+constexpr uint16_t CHIGO_HEADER_SPACE           = 7302;
+constexpr uint16_t CHIGO_BIT_MARK               = 500;
+constexpr uint16_t CHIGO_ZERO_SPACE             = 500;
+constexpr uint16_t CHIGO_ONE_SPACE              = 1570;
+constexpr uint16_t CHIGO_FOOTER_MARK            = 608;
+constexpr uint16_t CHIGO_FOOTER_SPACE           = 7372;
+constexpr uint16_t CHIGO_FOOTER_END_MARK        = 616;
 
 // Timers (signal range 0-3)
-#define CHIGO_TIMER_SKIP          "FF00"
-#define CHIGO_TIMER_NEW_0h        "FB04"
-#define CHIGO_TIMER_OLD_0h        "FB04"
-#define CHIGO_TIMER_NEW_1h        "7A85"
-#define CHIGO_TIMER_OLD_1h        "7E81"
-#define CHIGO_TIMER_NEW_2h        "BA45"
-#define CHIGO_TIMER_OLD_2h        "BE41"
-#define CHIGO_TIMER_NEW_3h        "3AC5"
-#define CHIGO_TIMER_OLD_3h        "3EC1"
-#define CHIGO_TIMER_NEW_4h        "DA25"
-#define CHIGO_TIMER_OLD_4h        "DE21"
-#define CHIGO_TIMER_NEW_5h        "5AA5"
-#define CHIGO_TIMER_OLD_5h        "5EA1"
-#define CHIGO_TIMER_NEW_6h        "9A65"
-#define CHIGO_TIMER_OLD_6h        "9E61"
-#define CHIGO_TIMER_NEW_7h        "1AE5"
-#define CHIGO_TIMER_OLD_7h        "1EE1"
-#define CHIGO_TIMER_NEW_8h        "EA15"
-#define CHIGO_TIMER_OLD_8h        "EE11"
-#define CHIGO_TIMER_NEW_9h        "6A95"
-#define CHIGO_TIMER_OLD_9h        "6E91"
-#define CHIGO_TIMER_NEW_10h       "AA55"
-#define CHIGO_TIMER_OLD_10h       "AE51"
-#define CHIGO_TIMER_NEW_11h       "2AD5"
-#define CHIGO_TIMER_OLD_11h       "2ED1"
-#define CHIGO_TIMER_NEW_12h       "CA35"
-#define CHIGO_TIMER_OLD_12h       "CE31"
-#define CHIGO_TIMER_NEW_13h       "4AB5"
-#define CHIGO_TIMER_OLD_13h       "4EB1"
-#define CHIGO_TIMER_NEW_14h       "8A75"
-#define CHIGO_TIMER_OLD_14h       "8E71"
-#define CHIGO_TIMER_NEW_15h       "0AF5"
-#define CHIGO_TIMER_OLD_15h       "0EF1"
-#define CHIGO_TIMER_NEW_16h       "F20D"
-#define CHIGO_TIMER_OLD_16h       "F609"
-#define CHIGO_TIMER_NEW_17h       "728D"
-#define CHIGO_TIMER_OLD_17h       "7689"
-#define CHIGO_TIMER_NEW_18h       "B24D"
-#define CHIGO_TIMER_OLD_18h       "B649"
-#define CHIGO_TIMER_NEW_19h       "32CD"
-#define CHIGO_TIMER_OLD_19h       "36C9"
-#define CHIGO_TIMER_NEW_20h       "D22D"
-#define CHIGO_TIMER_OLD_20h       "D629"
-#define CHIGO_TIMER_NEW_21h       "52AD"
-#define CHIGO_TIMER_OLD_21h       "56A9"
-#define CHIGO_TIMER_NEW_22h       "926D"
-#define CHIGO_TIMER_OLD_22h       "9669"
-#define CHIGO_TIMER_NEW_23h       "12ED"
-#define CHIGO_TIMER_OLD_23h       "16E9"
-#define CHIGO_TIMER_NEW_24h       "E21D"
-#define CHIGO_TIMER_OLD_24h       "E619"
+constexpr uint16_t CHIGO_TIMER_SKIP             = 0xFF00;
+constexpr uint16_t CHIGO_TIMER_NEW_0h           = 0xFB04;
+constexpr uint16_t CHIGO_TIMER_OLD_0h           = 0xFB04;
+constexpr uint16_t CHIGO_TIMER_NEW_1h           = 0x7A85;
+constexpr uint16_t CHIGO_TIMER_OLD_1h           = 0x7E81;
+constexpr uint16_t CHIGO_TIMER_NEW_2h           = 0xBA45;
+constexpr uint16_t CHIGO_TIMER_OLD_2h           = 0xBE41;
+constexpr uint16_t CHIGO_TIMER_NEW_3h           = 0x3AC5;
+constexpr uint16_t CHIGO_TIMER_OLD_3h           = 0x3EC1;
+constexpr uint16_t CHIGO_TIMER_NEW_4h           = 0xDA25;
+constexpr uint16_t CHIGO_TIMER_OLD_4h           = 0xDE21;
+constexpr uint16_t CHIGO_TIMER_NEW_5h           = 0x5AA5;
+constexpr uint16_t CHIGO_TIMER_OLD_5h           = 0x5EA1;
+constexpr uint16_t CHIGO_TIMER_NEW_6h           = 0x9A65;
+constexpr uint16_t CHIGO_TIMER_OLD_6h           = 0x9E61;
+constexpr uint16_t CHIGO_TIMER_NEW_7h           = 0x1AE5;
+constexpr uint16_t CHIGO_TIMER_OLD_7h           = 0x1EE1;
+constexpr uint16_t CHIGO_TIMER_NEW_8h           = 0xEA15;
+constexpr uint16_t CHIGO_TIMER_OLD_8h           = 0xEE11;
+constexpr uint16_t CHIGO_TIMER_NEW_9h           = 0x6A95;
+constexpr uint16_t CHIGO_TIMER_OLD_9h           = 0x6E91;
+constexpr uint16_t CHIGO_TIMER_NEW_10h          = 0xAA55;
+constexpr uint16_t CHIGO_TIMER_OLD_10h          = 0xAE51;
+constexpr uint16_t CHIGO_TIMER_NEW_11h          = 0x2AD5;
+constexpr uint16_t CHIGO_TIMER_OLD_11h          = 0x2ED1;
+constexpr uint16_t CHIGO_TIMER_NEW_12h          = 0xCA35;
+constexpr uint16_t CHIGO_TIMER_OLD_12h          = 0xCE31;
+constexpr uint16_t CHIGO_TIMER_NEW_13h          = 0x4AB5;
+constexpr uint16_t CHIGO_TIMER_OLD_13h          = 0x4EB1;
+constexpr uint16_t CHIGO_TIMER_NEW_14h          = 0x8A75;
+constexpr uint16_t CHIGO_TIMER_OLD_14h          = 0x8E71;
+constexpr uint16_t CHIGO_TIMER_NEW_15h          = 0x0AF5;
+constexpr uint16_t CHIGO_TIMER_OLD_15h          = 0x0EF1;
+constexpr uint16_t CHIGO_TIMER_NEW_16h          = 0xF20D;
+constexpr uint16_t CHIGO_TIMER_OLD_16h          = 0xF609;
+constexpr uint16_t CHIGO_TIMER_NEW_17h          = 0x728D;
+constexpr uint16_t CHIGO_TIMER_OLD_17h          = 0x7689;
+constexpr uint16_t CHIGO_TIMER_NEW_18h          = 0xB24D;
+constexpr uint16_t CHIGO_TIMER_OLD_18h          = 0xB649;
+constexpr uint16_t CHIGO_TIMER_NEW_19h          = 0x32CD;
+constexpr uint16_t CHIGO_TIMER_OLD_19h          = 0x36C9;
+constexpr uint16_t CHIGO_TIMER_NEW_20h          = 0xD22D;
+constexpr uint16_t CHIGO_TIMER_OLD_20h          = 0xD629;
+constexpr uint16_t CHIGO_TIMER_NEW_21h          = 0x52AD;
+constexpr uint16_t CHIGO_TIMER_OLD_21h          = 0x56A9;
+constexpr uint16_t CHIGO_TIMER_NEW_22h          = 0x926D;
+constexpr uint16_t CHIGO_TIMER_OLD_22h          = 0x9669;
+constexpr uint16_t CHIGO_TIMER_NEW_23h          = 0x12ED;
+constexpr uint16_t CHIGO_TIMER_OLD_23h          = 0x16E9;
+constexpr uint16_t CHIGO_TIMER_NEW_24h          = 0xE21D;
+constexpr uint16_t CHIGO_TIMER_OLD_24h          = 0xE619;
 
 // Extra (signal range 4-7)
-#define CHIGO_EXTRA_DEFAULT       "FF00"
-#define CHIGO_EXTRA_TURBO         "EF10"
-#define CHIGO_EXTRA_HOLD          "DF20"
-#define CHIGO_EXTRA_TURBO_HOLD    "CF30"
+constexpr uint16_t CHIGO_EXTRA_DEFAULT          = 0xFF00;
+constexpr uint16_t CHIGO_EXTRA_TURBO            = 0xEF10;
+constexpr uint16_t CHIGO_EXTRA_HOLD             = 0xDF20;
+constexpr uint16_t CHIGO_EXTRA_TURBO_HOLD       = 0xCF30;
 
 
 // Commands (signal range 8-11)
-#define CHIGO_CMD_TEMP_UP         "BF40"
-#define CHIGO_CMD_TEMP_DOWN       "3FC0"
-#define CHIGO_CMD_MODE            "7F80"
-#define CHIGO_CMD_SPEED           "5FA0"
-#define CHIGO_CMD_SLEEP           "6F90"
-#define CHIGO_CMD_POWER           "FF00"
-#define CHIGO_CMD_SWING           "DF20"
-#define CHIGO_CMD_AIRFLOW         "1FE0"
+constexpr uint16_t CHIGO_CMD_TEMP_UP            = 0xBF40;
+constexpr uint16_t CHIGO_CMD_TEMP_DOWN          = 0x3FC0;
+constexpr uint16_t CHIGO_CMD_MODE               = 0x7F80;
+constexpr uint16_t CHIGO_CMD_SPEED              = 0x5FA0;
+constexpr uint16_t CHIGO_CMD_SLEEP              = 0x6F90;
+constexpr uint16_t CHIGO_CMD_POWER              = 0xFF00;
+constexpr uint16_t CHIGO_CMD_SWING              = 0xDF20;
+constexpr uint16_t CHIGO_CMD_AIRFLOW            = 0x1FE0;
 // TODO: Clean, Lamp
 
 // Power parameters (signal range 12-15)
 // Merged with air speed code
-#define CHIGO_PARAM_POWEROFF_SWING_0 "E010"
-#define CHIGO_PARAM_POWEROFF_SWING_1 "F000"
-#define CHIGO_PARAM_POWEROFF_SWING_2 "D020"
+constexpr uint16_t CHIGO_PARAM_POWEROFF_SWING_0 = 0xE010;
+constexpr uint16_t CHIGO_PARAM_POWEROFF_SWING_1 = 0xF000;
+constexpr uint16_t CHIGO_PARAM_POWEROFF_SWING_2 = 0xD020;
 
 // Swing, speed and air flow parameters (signal range 12-15)
 // Speed and swing params have to be merged (e.g. 0906 + A050 = A956)
-#define CHIGO_PARAM_SPEED_SLOW       "0906" // AirFlow off
-#define CHIGO_PARAM_SPEED_MEDIUM     "0D02" // AirFlow off
-#define CHIGO_PARAM_SPEED_FAST       "0B04" // AirFlow off
-#define CHIGO_PARAM_SPEED_SMART      "0F00" // AirFlow off
-#define CHIGO_PARAM_SPEED_AF_SLOW    "010E" // AirFlow on
-#define CHIGO_PARAM_SPEED_AF_MEDIUM  "050A" // AirFlow on
-#define CHIGO_PARAM_SPEED_AF_FAST    "030C" // AirFlow on
-#define CHIGO_PARAM_SPEED_AF_SMART   "0708" // AirFlow on
-#define CHIGO_PARAM_SWING_0          "A050" // Sleep Mode off
-#define CHIGO_PARAM_SWING_1          "B040" // Sleep Mode off
-#define CHIGO_PARAM_SWING_2          "9060" // Sleep Mode off
-#define CHIGO_PARAM_SWING_SLEEP_0    "20D0" // Sleep Mode on
-#define CHIGO_PARAM_SWING_SLEEP_1    "30C0" // Sleep Mode on
-#define CHIGO_PARAM_SWING_SLEEP_2    "10E0" // Sleep Mode on
+constexpr uint16_t CHIGO_PARAM_SPEED_SLOW       = 0x0906; // AirFlow off
+constexpr uint16_t CHIGO_PARAM_SPEED_MEDIUM     = 0x0D02; // AirFlow off
+constexpr uint16_t CHIGO_PARAM_SPEED_FAST       = 0x0B04; // AirFlow off
+constexpr uint16_t CHIGO_PARAM_SPEED_SMART      = 0x0F00; // AirFlow off
+constexpr uint16_t CHIGO_PARAM_SPEED_AF_SLOW    = 0x010E; // AirFlow on
+constexpr uint16_t CHIGO_PARAM_SPEED_AF_MEDIUM  = 0x050A; // AirFlow on
+constexpr uint16_t CHIGO_PARAM_SPEED_AF_FAST    = 0x030C; // AirFlow on
+constexpr uint16_t CHIGO_PARAM_SPEED_AF_SMART   = 0x0708; // AirFlow on
+constexpr uint16_t CHIGO_PARAM_SWING_0          = 0xA050; // Sleep Mode off
+constexpr uint16_t CHIGO_PARAM_SWING_1          = 0xB040; // Sleep Mode off
+constexpr uint16_t CHIGO_PARAM_SWING_2          = 0x9060; // Sleep Mode off
+constexpr uint16_t CHIGO_PARAM_SWING_SLEEP_0    = 0x20D0; // Sleep Mode on
+constexpr uint16_t CHIGO_PARAM_SWING_SLEEP_1    = 0x30C0; // Sleep Mode on
+constexpr uint16_t CHIGO_PARAM_SWING_SLEEP_2    = 0x10E0; // Sleep Mode on
 
 // Temperature and AC mode parameters (signal range 16-19)
-#define CHIGO_PARAM_TEMP_16          "F000"
-#define CHIGO_PARAM_TEMP_17          "7080"
-#define CHIGO_PARAM_TEMP_18          "B040"
-#define CHIGO_PARAM_TEMP_19          "30C0"
-#define CHIGO_PARAM_TEMP_20          "D020"
-#define CHIGO_PARAM_TEMP_21          "50A0"
-#define CHIGO_PARAM_TEMP_22          "9060"
-#define CHIGO_PARAM_TEMP_23          "10E0"
-#define CHIGO_PARAM_TEMP_24          "E010"
-#define CHIGO_PARAM_TEMP_25          "6090"
-#define CHIGO_PARAM_TEMP_26          "A050"
-#define CHIGO_PARAM_TEMP_27          "20D0"
-#define CHIGO_PARAM_TEMP_28          "C030"
-#define CHIGO_PARAM_TEMP_29          "40B0"
-#define CHIGO_PARAM_TEMP_30          "8070"
-#define CHIGO_PARAM_TEMP_31          "00F0"
-#define CHIGO_PARAM_TEMP_32          "F000"
-#define CHIGO_PARAM_MODE_AUTO        "0F00"
-#define CHIGO_PARAM_MODE_COOL        "0B04"
-#define CHIGO_PARAM_MODE_COOL_ALT    "030C"
-#define CHIGO_PARAM_MODE_HEAT        "0E01"
-#define CHIGO_PARAM_MODE_HEAT_ALT    "0609"
-#define CHIGO_PARAM_MODE_DRY         "0D02"
-#define CHIGO_PARAM_MODE_FAN         "0906"
-#define CHIGO_PARAM_MODE_FAN_ALT     "010E"
+constexpr uint16_t CHIGO_PARAM_TEMP_16          = 0xF000;
+constexpr uint16_t CHIGO_PARAM_TEMP_17          = 0x7080;
+constexpr uint16_t CHIGO_PARAM_TEMP_18          = 0xB040;
+constexpr uint16_t CHIGO_PARAM_TEMP_19          = 0x30C0;
+constexpr uint16_t CHIGO_PARAM_TEMP_20          = 0xD020;
+constexpr uint16_t CHIGO_PARAM_TEMP_21          = 0x50A0;
+constexpr uint16_t CHIGO_PARAM_TEMP_22          = 0x9060;
+constexpr uint16_t CHIGO_PARAM_TEMP_23          = 0x10E0;
+constexpr uint16_t CHIGO_PARAM_TEMP_24          = 0xE010;
+constexpr uint16_t CHIGO_PARAM_TEMP_25          = 0x6090;
+constexpr uint16_t CHIGO_PARAM_TEMP_26          = 0xA050;
+constexpr uint16_t CHIGO_PARAM_TEMP_27          = 0x20D0;
+constexpr uint16_t CHIGO_PARAM_TEMP_28          = 0xC030;
+constexpr uint16_t CHIGO_PARAM_TEMP_29          = 0x40B0;
+constexpr uint16_t CHIGO_PARAM_TEMP_30          = 0x8070;
+constexpr uint16_t CHIGO_PARAM_TEMP_31          = 0x00F0;
+constexpr uint16_t CHIGO_PARAM_TEMP_32          = 0xF000;
+constexpr uint16_t CHIGO_PARAM_MODE_AUTO        = 0x0F00;
+constexpr uint16_t CHIGO_PARAM_MODE_COOL        = 0x0B04;
+constexpr uint16_t CHIGO_PARAM_MODE_COOL_ALT    = 0x030C;
+constexpr uint16_t CHIGO_PARAM_MODE_HEAT        = 0x0E01;
+constexpr uint16_t CHIGO_PARAM_MODE_HEAT_ALT    = 0x0609;
+constexpr uint16_t CHIGO_PARAM_MODE_DRY         = 0x0D02;
+constexpr uint16_t CHIGO_PARAM_MODE_FAN         = 0x0906;
+constexpr uint16_t CHIGO_PARAM_MODE_FAN_ALT     = 0x010E;
 
 // Other
-#define CHIGO_TEMP_MIN            16U
-#define CHIGO_TEMP_MAX            32U
\ No newline at end of file
+constexpr unsigned CHIGO_TEMP_MIN                = 16U;
+constexpr unsigned CHIGO_TEMP_MAX                = 32U;
+
+// Nibble masks
+// Every field is sent as two interleaved nibbles: the value and its complement
+constexpr uint16_t CHIGO_MASK_HIGH              = 0xF0F0; // 1st and 3rd nibble
+constexpr uint16_t CHIGO_MASK_LOW               = 0x0F0F; // 2nd and 4th nibble
+constexpr uint16_t CHIGO_MASK_TIMER_DELAY       = CHIGO_MASK_HIGH;
+constexpr uint16_t CHIGO_MASK_TIMER_KIND        = CHIGO_MASK_LOW;
+constexpr uint16_t CHIGO_MASK_EXTRA             = CHIGO_MASK_HIGH;
+constexpr uint16_t CHIGO_MASK_SWING             = CHIGO_MASK_HIGH; // swing, sleep, power off
+constexpr uint16_t CHIGO_MASK_SPEED             = CHIGO_MASK_LOW;  // speed, air flow
+constexpr uint16_t CHIGO_MASK_TEMP              = CHIGO_MASK_HIGH;
+constexpr uint16_t CHIGO_MASK_MODE              = CHIGO_MASK_LOW;
+
+/**
+ * Temperature (16-32)
+ * Low nibbles get replaced with current Mode nibbles
+ */
+constexpr uint16_t temperatures[17] = {
+  CHIGO_PARAM_TEMP_16,
+  CHIGO_PARAM_TEMP_17,
+  CHIGO_PARAM_TEMP_18,
+  CHIGO_PARAM_TEMP_19,
+  CHIGO_PARAM_TEMP_20,
+  CHIGO_PARAM_TEMP_21,
+  CHIGO_PARAM_TEMP_22,
+  CHIGO_PARAM_TEMP_23,
+  CHIGO_PARAM_TEMP_24,
+  CHIGO_PARAM_TEMP_25,
+  CHIGO_PARAM_TEMP_26,
+  CHIGO_PARAM_TEMP_27,
+  CHIGO_PARAM_TEMP_28,
+  CHIGO_PARAM_TEMP_29,
+  CHIGO_PARAM_TEMP_30,
+  CHIGO_PARAM_TEMP_31,
+  CHIGO_PARAM_TEMP_32
+};
+
+constexpr uint16_t newTimerDelays[25] = {
+  CHIGO_TIMER_NEW_0h,
+  CHIGO_TIMER_NEW_1h,
+  CHIGO_TIMER_NEW_2h,
+  CHIGO_TIMER_NEW_3h,
+  CHIGO_TIMER_NEW_4h,
+  CHIGO_TIMER_NEW_5h,
+  CHIGO_TIMER_NEW_6h,
+  CHIGO_TIMER_NEW_7h,
+  CHIGO_TIMER_NEW_8h,
+  CHIGO_TIMER_NEW_9h,
+  CHIGO_TIMER_NEW_10h,
+  CHIGO_TIMER_NEW_11h,
+  CHIGO_TIMER_NEW_12h,
+  CHIGO_TIMER_NEW_13h,
+  CHIGO_TIMER_NEW_14h,
+  CHIGO_TIMER_NEW_15h,
+  CHIGO_TIMER_NEW_16h,
+  CHIGO_TIMER_NEW_17h,
+  CHIGO_TIMER_NEW_18h,
+  CHIGO_TIMER_NEW_19h,
+  CHIGO_TIMER_NEW_20h,
+  CHIGO_TIMER_NEW_21h,
+  CHIGO_TIMER_NEW_22h,
+  CHIGO_TIMER_NEW_23h,
+  CHIGO_TIMER_NEW_24h,
+};
+
+constexpr uint16_t oldTimerDelays[25] = {
+  CHIGO_TIMER_OLD_0h,
+  CHIGO_TIMER_OLD_1h,
+  CHIGO_TIMER_OLD_2h,
+  CHIGO_TIMER_OLD_3h,
+  CHIGO_TIMER_OLD_4h,
+  CHIGO_TIMER_OLD_5h,
+  CHIGO_TIMER_OLD_6h,
+  CHIGO_TIMER_OLD_7h,
+  CHIGO_TIMER_OLD_8h,
+  CHIGO_TIMER_OLD_9h,
+  CHIGO_TIMER_OLD_10h,
+  CHIGO_TIMER_OLD_11h,
+  CHIGO_TIMER_OLD_12h,
+  CHIGO_TIMER_OLD_13h,
+  CHIGO_TIMER_OLD_14h,
+  CHIGO_TIMER_OLD_15h,
+  CHIGO_TIMER_OLD_16h,
+  CHIGO_TIMER_OLD_17h,
+  CHIGO_TIMER_OLD_18h,
+  CHIGO_TIMER_OLD_19h,
+  CHIGO_TIMER_OLD_20h,
+  CHIGO_TIMER_OLD_21h,
+  CHIGO_TIMER_OLD_22h,
+  CHIGO_TIMER_OLD_23h,
+  CHIGO_TIMER_OLD_24h,
+};
+
+/**
+ * Inverse lookup tables
+ * A masked field is packed into one byte (its two nibbles) and used as an
+ * index into a 256-entry table. Unknown codes map to CHIGO_INVALID.
+ */
+constexpr uint8_t CHIGO_INVALID                 = 0xFF;
+
+// Decoded value flags
+constexpr uint8_t CHIGO_TIMER_KEEP              = 0x01; // timer kind: keep old timer
+constexpr uint8_t CHIGO_TIMER_16h               = 0x02; // timer kind: 16-24h range
+constexpr uint8_t CHIGO_EXTRA_TURBO_FLAG        = 0x01;
+constexpr uint8_t CHIGO_EXTRA_HOLD_FLAG         = 0x02;
+constexpr uint8_t CHIGO_SWING_VALUE             = 0x03; // swing: 0-2
+constexpr uint8_t CHIGO_SWING_SLEEP             = 0x04;
+constexpr uint8_t CHIGO_SWING_POWEROFF          = 0x08;
+constexpr uint8_t CHIGO_SPEED_VALUE             = 0x03; // speed: Slow-Smart
+constexpr uint8_t CHIGO_SPEED_AIRFLOW           = 0x04;
+constexpr uint8_t CHIGO_MODE_VALUE              = 0x07; // mode: Auto-Fan
+constexpr uint8_t CHIGO_MODE_ALT                = 0x08; // alternative code for 32C
+
+struct CodeTable {
+  uint8_t values[256];
+};
+
+constexpr uint8_t chigoPackNibbles(uint16_t code) {
+  return ((code >> 4) & 0xF0) | (code & 0x0F);
+}
+
+constexpr uint8_t chigoFieldIndex(uint16_t code, uint16_t mask) {
+  return mask == CHIGO_MASK_HIGH ? chigoPackNibbles(code >> 4) : chigoPackNibbles(code);
+}
+
+// Build table mapping codes[i] to values[i] (or to i if values are omitted)
+constexpr CodeTable chigoInverseTable(const uint16_t *codes, const uint8_t *values, size_t count, uint16_t mask) {
+  CodeTable table = {};
+  for (size_t i = 0; i < 256; i++)
+    table.values[i] = CHIGO_INVALID;
+  for (size_t i = 0; i < count; i++)
+    table.values[chigoFieldIndex(codes[i], mask)] = values ? values[i] : i;
+  return table;
+}
+
+constexpr uint16_t CHIGO_TIMER_KINDS[] = {
+  CHIGO_TIMER_NEW_1h, CHIGO_TIMER_OLD_1h, CHIGO_TIMER_NEW_16h, CHIGO_TIMER_OLD_16h, CHIGO_TIMER_OLD_0h
+};
+constexpr uint8_t CHIGO_TIMER_KIND_VALUES[] = {
+  0, CHIGO_TIMER_KEEP, CHIGO_TIMER_16h, CHIGO_TIMER_KEEP | CHIGO_TIMER_16h, CHIGO_TIMER_KEEP
+};
+
+constexpr uint16_t CHIGO_EXTRAS[] = {
+  CHIGO_EXTRA_DEFAULT, CHIGO_EXTRA_TURBO, CHIGO_EXTRA_HOLD, CHIGO_EXTRA_TURBO_HOLD
+};
+constexpr uint8_t CHIGO_EXTRA_VALUES[] = {
+  0, CHIGO_EXTRA_TURBO_FLAG, CHIGO_EXTRA_HOLD_FLAG, CHIGO_EXTRA_TURBO_FLAG | CHIGO_EXTRA_HOLD_FLAG
+};
+
+constexpr uint16_t CHIGO_SWINGS[] = {
+  CHIGO_PARAM_SWING_0, CHIGO_PARAM_SWING_1, CHIGO_PARAM_SWING_2,
+  CHIGO_PARAM_SWING_SLEEP_0, CHIGO_PARAM_SWING_SLEEP_1, CHIGO_PARAM_SWING_SLEEP_2,
+  CHIGO_PARAM_POWEROFF_SWING_0, CHIGO_PARAM_POWEROFF_SWING_1, CHIGO_PARAM_POWEROFF_SWING_2
+};
+constexpr uint8_t CHIGO_SWING_VALUES[] = {
+  0, 1, 2,
+  0 | CHIGO_SWING_SLEEP, 1 | CHIGO_SWING_SLEEP, 2 | CHIGO_SWING_SLEEP,
+  0 | CHIGO_SWING_POWEROFF, 1 | CHIGO_SWING_POWEROFF, 2 | CHIGO_SWING_POWEROFF
+};
+
+// Values follow the Speed enum order (Slow, Medium, Fast, Smart)
+constexpr uint16_t CHIGO_SPEEDS[] = {
+  CHIGO_PARAM_SPEED_SLOW, CHIGO_PARAM_SPEED_MEDIUM, CHIGO_PARAM_SPEED_FAST, CHIGO_PARAM_SPEED_SMART,
+  CHIGO_PARAM_SPEED_AF_SLOW, CHIGO_PARAM_SPEED_AF_MEDIUM, CHIGO_PARAM_SPEED_AF_FAST, CHIGO_PARAM_SPEED_AF_SMART
+};
+constexpr uint8_t CHIGO_SPEED_VALUES[] = {
+  0, 1, 2, 3,
+  0 | CHIGO_SPEED_AIRFLOW, 1 | CHIGO_SPEED_AIRFLOW, 2 | CHIGO_SPEED_AIRFLOW, 3 | CHIGO_SPEED_AIRFLOW
+};
+
+// Values follow the Mode enum order (Auto, Cool, Dry, Heat, Fan)
+constexpr uint16_t CHIGO_MODES[] = {
+  CHIGO_PARAM_MODE_AUTO, CHIGO_PARAM_MODE_COOL, CHIGO_PARAM_MODE_COOL_ALT, CHIGO_PARAM_MODE_DRY,
+  CHIGO_PARAM_MODE_HEAT, CHIGO_PARAM_MODE_HEAT_ALT, CHIGO_PARAM_MODE_FAN, CHIGO_PARAM_MODE_FAN_ALT
+};
+constexpr uint8_t CHIGO_MODE_VALUES[] = {
+  0, 1, 1 | CHIGO_MODE_ALT, 2,
+  3, 3 | CHIGO_MODE_ALT, 4, 4 | CHIGO_MODE_ALT
+};
+
+// Temperatures and timer delays share the same 0-15 sequence
+constexpr CodeTable timerDelayTable PROGMEM = chigoInverseTable(newTimerDelays, NULL, 16, CHIGO_MASK_TIMER_DELAY);
+constexpr CodeTable timerKindTable PROGMEM = chigoInverseTable(CHIGO_TIMER_KINDS, CHIGO_TIMER_KIND_VALUES, 5, CHIGO_MASK_TIMER_KIND);
+constexpr CodeTable extraTable PROGMEM = chigoInverseTable(CHIGO_EXTRAS, CHIGO_EXTRA_VALUES, 4, CHIGO_MASK_EXTRA);
+constexpr CodeTable swingTable PROGMEM = chigoInverseTable(CHIGO_SWINGS, CHIGO_SWING_VALUES, 9, CHIGO_MASK_SWING);
+constexpr CodeTable speedTable PROGMEM = chigoInverseTable(CHIGO_SPEEDS, CHIGO_SPEED_VALUES, 8, CHIGO_MASK_SPEED);
+constexpr CodeTable temperatureTable PROGMEM = chigoInverseTable(temperatures, NULL, 16, CHIGO_MASK_TEMP);
+constexpr CodeTable modeTable PROGMEM = chigoInverseTable(CHIGO_MODES, CHIGO_MODE_VALUES, 8, CHIGO_MASK_MODE);
+
+/**
+ * Read a single field from a code: one mask, one table index
+ */
+inline uint8_t chigoLookup(const CodeTable &table, uint16_t code, uint16_t mask) {
+  return pgm_read_byte(&table.values[chigoFieldIndex(code, mask)]);
+}
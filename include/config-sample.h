@@ -1,8 +1,12 @@
 #define SEND_PIN      15 // NodeMCU 15=D8
 #define RECV_PIN      14 // NodeMCU 14=D5
+#define RECV_UNIT     0 // Unit whose remote the receiver picks up
 #define DEBUG_MODE    false // Dump debugging info to serial monitor
 #define MEMORY_MODE   true // Save HVAC state in EEPROM
 #define MEMORY_INIT   false // Run only once on new device to prepare EEPROM
+#define JSON_STATE    false // Publish state as one JSON message (<prefix>/state/get)
+#define IR_RECORDER   false // Dump received IR frames over serial (corpus format)
+// #define RESTART_TOPIC "my_topic/restart" // Optional: payload "restart" restarts the node
 
 const char* ssid = "";
 const char* password = "";
@@ -11,13 +15,14 @@ const char* mqtt_username = "";
 const char* mqtt_password = "";
 const char* clientID = "ZHJT-03";
 const char* topic_handshake = "my_topic/handshake";
-const char* topic_power_publish = "my_topic/power/get";
-const char* topic_power_subscribe = "my_topic/power/set";
-const char* topic_temperature_publish = "my_topic/temperature/get";
-const char* topic_temperature_subscribe = "my_topic/temperature/set";
-const char* topic_mode_publish = "my_topic/mode/get";
-const char* topic_mode_subscribe = "my_topic/mode/set";
-const char* topic_fan_publish = "my_topic/fan/get";
-const char* topic_fan_subscribe = "my_topic/fan/set";
-const char* topic_swing_publish = "my_topic/swing/get";
-const char* topic_swing_subscribe = "my_topic/swing/set";
\ No newline at end of file
+#define DIAGNOSTICS_TOPIC "my_topic/diagnostics" // Optional: stage latencies (see README)
+#define METRICS_TOPIC     "my_topic/metrics" // Optional: runtime metrics (see README)
+
+// One entry per AC unit: IR send pin and MQTT topic prefix. Each unit has
+// <prefix>/state/get, <prefix>/power/get, <prefix>/power/set and so on for
+// temperature, mode, fan and swing. Without UNIT_TOPICS, the per-field
+// topics of former versions (topic_power_publish, topic_power_subscribe,
+// ...) are used for a single unit.
+#define HVAC_UNITS     1
+#define UNIT_SEND_PINS {SEND_PIN}
+#define UNIT_TOPICS    {"my_topic"}
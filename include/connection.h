@@ -0,0 +1,180 @@
+// Status LED (blinks while joining WiFi)
+#ifndef LED
+#define LED D0
+#endif
+
+// Give up on a WiFi join attempt after this long (ms)
+#ifndef WIFI_JOIN_TIMEOUT_MS
+#define WIFI_JOIN_TIMEOUT_MS 15000
+#endif
+
+// Reconnect backoff: first and longest delay between attempts (ms)
+#ifndef BACKOFF_MIN_MS
+#define BACKOFF_MIN_MS 1000
+#endif
+
+#ifndef BACKOFF_MAX_MS
+#define BACKOFF_MAX_MS 60000
+#endif
+
+// Bound for a single TCP connect to the broker (ms)
+#ifndef MQTT_CONNECT_TIMEOUT_MS
+#define MQTT_CONNECT_TIMEOUT_MS 2000
+#endif
+
+enum ConnectionStatus {
+  CONN_WIFI_JOIN,    // WiFi.begin() issued, waiting for an address
+  CONN_WIFI_WAIT,    // join failed, waiting for the next attempt
+  CONN_MQTT_WAIT,    // WiFi up, waiting for the next broker attempt
+  CONN_CONNECTED
+};
+
+typedef void (*ConnectCallback)();
+
+/**
+ * Non-blocking WiFi/MQTT connection
+ *
+ * Stepped from loop(): every call does at most one connection attempt and
+ * returns, so IR receive and local state tracking keep running while the
+ * network or the broker is away. Failed attempts are retried with a
+ * jittered exponential backoff.
+ */
+class Connection {
+
+  private: PubSubClient &client;
+  private: ConnectionStatus status = CONN_WIFI_WAIT;
+  private: ConnectCallback callback = NULL;
+  private: unsigned long since = 0;          // entered current status
+  private: unsigned long retryAt = 0;
+  private: unsigned long backoff = 0;
+  private: unsigned long disconnectedAt = 0;
+
+  public: uint32_t attempts = 0;
+  public: uint32_t failures = 0;
+  public: uint32_t drops = 0;
+  public: unsigned long disconnectedMs = 0;  // completed outages
+
+  public: Connection(PubSubClient &client) : client(client) {}
+
+  public: void begin(ConnectCallback onConnected = NULL) {
+    callback = onConnected;
+    WiFi.mode(WIFI_STA);
+    disconnectedAt = millis();
+    retryAt = disconnectedAt;
+  }
+
+  public: ConnectionStatus state() {
+    return status;
+  }
+
+  public: bool isConnected() {
+    return status == CONN_CONNECTED;
+  }
+
+  /**
+   * Total time spent disconnected, including the current outage (ms)
+   */
+  public: unsigned long downtime() {
+    if (status == CONN_CONNECTED)
+      return disconnectedMs;
+    return disconnectedMs + (millis() - disconnectedAt);
+  }
+
+  public: void loop() {
+    unsigned long now = millis();
+
+    switch (status) {
+      case CONN_CONNECTED:
+        if (WiFi.status() != WL_CONNECTED || !client.loop()) {
+          Serial.println("[MQTT] Connection lost");
+          drops++;
+          disconnectedAt = now;
+          backoff = 0;
+          enter(WiFi.status() == WL_CONNECTED ? CONN_MQTT_WAIT : CONN_WIFI_JOIN, now);
+        }
+        break;
+
+      case CONN_WIFI_WAIT:
+        if (due(now)) {
+          Serial.print("[WIFI] Connecting to ");
+          Serial.println(ssid);
+          WiFi.begin(ssid, password);
+          attempts++;
+          enter(CONN_WIFI_JOIN, now);
+        }
+        break;
+
+      case CONN_WIFI_JOIN:
+        digitalWrite(LED, (now / 500) & 1);
+        if (WiFi.status() == WL_CONNECTED) {
+          Serial.print("[WIFI] Connected (IP: ");
+          Serial.print(WiFi.localIP());
+          Serial.println(")");
+          digitalWrite(LED, LOW);
+          enter(CONN_MQTT_WAIT, now);
+        }
+        else if (now - since >= WIFI_JOIN_TIMEOUT_MS) {
+          Serial.println("[WIFI] Join timed out");
+          WiFi.disconnect();
+          digitalWrite(LED, LOW);
+          fail(CONN_WIFI_WAIT, now);
+        }
+        break;
+
+      case CONN_MQTT_WAIT:
+        if (WiFi.status() != WL_CONNECTED) {
+          enter(CONN_WIFI_JOIN, now);
+          break;
+        }
+        if (!due(now))
+          break;
+
+        Serial.print("[MQTT] Connecting to ");
+        Serial.print(mqtt_server);
+        Serial.print("...");
+        attempts++;
+        if (client.connect(clientID, mqtt_username, mqtt_password)) {
+          Serial.println(" connected");
+          disconnectedMs += millis() - disconnectedAt;
+          backoff = 0;
+          enter(CONN_CONNECTED, now);
+          if (DEBUG_MODE)
+            Serial.printf("[DEBUG] Disconnected for %lu ms in total, %u drops\n", disconnectedMs, drops);
+          if (callback)
+            callback();
+        }
+        else {
+          Serial.print(" failed, rc=");
+          Serial.println(client.state());
+          fail(CONN_MQTT_WAIT, millis());
+        }
+        break;
+    }
+  }
+
+  private: bool due(unsigned long now) {
+    return (long)(now - retryAt) >= 0;
+  }
+
+  private: void enter(ConnectionStatus next, unsigned long now) {
+    status = next;
+    since = now;
+    retryAt = now;
+  }
+
+  /**
+   * Schedule the next attempt: the delay doubles on every failure and a
+   * random half of it is dropped, so devices that lost the broker together
+   * do not reconnect in lockstep.
+   */
+  private: void fail(ConnectionStatus next, unsigned long now) {
+    failures++;
+    backoff = backoff ? backoff * 2 : BACKOFF_MIN_MS;
+    if (backoff > BACKOFF_MAX_MS)
+      backoff = BACKOFF_MAX_MS;
+    enter(next, now);
+    retryAt = now + backoff / 2 + random(backoff / 2 + 1);
+    if (DEBUG_MODE)
+      Serial.printf("[DEBUG] Next attempt in %lu ms\n", retryAt - now);
+  }
+};
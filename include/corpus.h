@@ -0,0 +1,105 @@
+#include <IRrecv.h>
+
+/**
+ * IR capture corpus
+ *
+ * Line based text, one record per line:
+ *
+ *   # comment
+ *   C 6234 7302 500 1570 ...   capture: mark/space durations (us), header mark first
+ *   S temp=24 mode=1 power=1   expected state after the capture above (optional)
+ *
+ * State labels may be partial, only the fields given are checked. Values are
+ * the numeric Mode/Speed/swing values used by HvacState. Debug builds with
+ * IR_RECORDER write both lines over Serial, prefixed with CORPUS_PREFIX, so a
+ * serial log can be replayed as is (other lines are skipped).
+ */
+
+// Dump every capture and the decoded state over Serial
+#ifndef IR_RECORDER
+#define IR_RECORDER false
+#endif
+
+#define CORPUS_PREFIX "[IRC] "
+
+struct CorpusField {
+  const char *name;
+  uint8_t shift;
+  uint8_t width;
+};
+
+const CorpusField corpusFields[] = {
+  {"power", STATE_POWER_SHIFT, 1},
+  {"mode", STATE_MODE_SHIFT, STATE_MODE_BITS},
+  {"temp", STATE_TEMPERATURE_SHIFT, STATE_TEMPERATURE_BITS},
+  {"fan", STATE_SPEED_SHIFT, STATE_SPEED_BITS},
+  {"swing", STATE_SWING_SHIFT, STATE_SWING_BITS},
+  {"airflow", STATE_AIRFLOW_SHIFT, 1},
+  {"sleep", STATE_SLEEP_SHIFT, 1},
+  {"turbo", STATE_TURBO_SHIFT, 1},
+  {"hold", STATE_HOLD_SHIFT, 1},
+  {"timer", STATE_TIMER_DELAY_SHIFT, STATE_TIMER_DELAY_BITS},
+};
+
+#define CORPUS_FIELDS (sizeof(corpusFields) / sizeof(corpusFields[0]))
+
+/**
+ * Write a capture line (the leading gap of the raw buffer is dropped)
+ */
+inline void recordCapture(const decode_results *results) {
+  Serial.print(CORPUS_PREFIX "C");
+  for (uint16_t i = 1; i < results->rawlen; i++) {
+    Serial.print(' ');
+    Serial.print((unsigned long)results->rawbuf[i] * RAWTICK);
+  }
+  Serial.println();
+}
+
+/**
+ * Write a state label with every field
+ */
+inline void recordState(const HvacState &state) {
+  Serial.print(CORPUS_PREFIX "S");
+  for (uint8_t i = 0; i < CORPUS_FIELDS; i++)
+    Serial.printf(" %s=%u", corpusFields[i].name,
+      (unsigned)((state.bits >> corpusFields[i].shift) & ((1UL << corpusFields[i].width) - 1)));
+  Serial.println();
+}
+
+/**
+ * Parse the key=value pairs of a state label into state and the mask of
+ * labelled fields. Returns false on unknown keys or out of range values.
+ */
+inline bool parseStateLabel(const char *text, HvacState &state, ChangeMask &labelled) {
+  labelled = 0;
+  while (*text) {
+    while (*text == ' ' || *text == '\t')
+      text++;
+    if (!*text || *text == '\r' || *text == '\n')
+      break;
+
+    const char *separator = strchr(text, '=');
+    if (!separator)
+      return false;
+
+    const CorpusField *field = NULL;
+    for (uint8_t i = 0; i < CORPUS_FIELDS; i++) {
+      size_t length = strlen(corpusFields[i].name);
+      if ((size_t)(separator - text) == length && strncmp(text, corpusFields[i].name, length) == 0)
+        field = &corpusFields[i];
+    }
+    if (!field)
+      return false;
+
+    char *end;
+    unsigned long value = strtoul(separator + 1, &end, 10);
+    if (end == separator + 1 || value >= (1UL << field->width))
+      return false;
+
+    ChangeMask mask = STATE_MASK(field->shift, field->width);
+    state.bits = (state.bits & ~mask) | ((uint32_t)value << field->shift);
+    labelled |= mask;
+    text = end;
+  }
+  return true;
+}
@@ -0,0 +1,106 @@
+// Frame cache size (finished raw buffers, ~400 bytes each)
+#ifndef FRAME_CACHE_SIZE
+#define FRAME_CACHE_SIZE 4
+#endif
+
+struct List {
+  uint16_t data[RAW_FRAME_LENGTH];
+  uint16_t counter = 0;
+};
+
+/**
+ * Mark/space durations of every nibble (MSB first), built at compile time
+ */
+struct NibbleWaveforms {
+  uint16_t durations[16][8];
+};
+
+constexpr NibbleWaveforms makeNibbleWaveforms() {
+  NibbleWaveforms waveforms = {};
+  for (int nibble = 0; nibble < 16; nibble++)
+    for (int bit = 0; bit < 4; bit++) {
+      waveforms.durations[nibble][bit * 2] = HvacProtocol::BIT_MARK;
+      waveforms.durations[nibble][bit * 2 + 1] = ((nibble >> (3 - bit)) & 1) ? HvacProtocol::ONE_SPACE : HvacProtocol::ZERO_SPACE;
+    }
+  return waveforms;
+}
+
+constexpr NibbleWaveforms nibbleWaveforms PROGMEM = makeNibbleWaveforms();
+
+/**
+ * Expand a packed frame into raw IR timings
+ */
+inline void encodeFrame(const Frame &frame, List &data) {
+  uint16_t words[FRAME_WORDS];
+  HvacProtocol::toWords(frame, words);
+
+  data.counter = 0;
+  data.data[data.counter++] = HvacProtocol::HEADER_MARK;
+  data.data[data.counter++] = HvacProtocol::HEADER_SPACE;
+
+  for (int i = 0; i < FRAME_WORDS; i++) {
+    for (int shift = 12; shift >= 0; shift -= 4) {
+      memcpy_P(&data.data[data.counter], nibbleWaveforms.durations[(words[i] >> shift) & 0xF], 8 * sizeof(uint16_t));
+      data.counter += 8;
+    }
+  }
+
+  data.data[data.counter++] = HvacProtocol::FOOTER_MARK;
+  data.data[data.counter++] = HvacProtocol::FOOTER_SPACE;
+  data.data[data.counter++] = HvacProtocol::FOOTER_END_MARK;
+}
+
+/**
+ * Small LRU cache of finished raw buffers
+ * Keyed by the packed frame, i.e. the command merged with the state it carries.
+ */
+class FrameCache {
+  private: struct Entry {
+    Frame key;
+    List raw;
+    uint32_t lastUsed = 0;
+    bool valid = false;
+  };
+
+  private: Entry entries[FRAME_CACHE_SIZE];
+  private: uint32_t clock = 0;
+  public: uint32_t hits = 0;
+  public: uint32_t misses = 0;
+
+  private: static bool sameFrame(const Frame &a, const Frame &b) {
+    uint16_t wordsA[FRAME_WORDS];
+    uint16_t wordsB[FRAME_WORDS];
+    HvacProtocol::toWords(a, wordsA);
+    HvacProtocol::toWords(b, wordsB);
+    return memcmp(wordsA, wordsB, sizeof(wordsA)) == 0;
+  }
+
+  /**
+   * Get raw timings for a frame, encoding it on a miss
+   */
+  public: const List& get(const Frame &frame) {
+    Entry *victim = &entries[0];
+    clock++;
+
+    for (int i = 0; i < FRAME_CACHE_SIZE; i++) {
+      Entry &entry = entries[i];
+      if (entry.valid && sameFrame(entry.key, frame)) {
+        entry.lastUsed = clock;
+        hits++;
+        return entry.raw;
+      }
+      if (!entry.valid || (victim->valid && entry.lastUsed < victim->lastUsed))
+        victim = &entry;
+    }
+
+    misses++;
+    victim->key = frame;
+    victim->valid = true;
+    victim->lastUsed = clock;
+    encodeFrame(frame, victim->raw);
+    return victim->raw;
+  }
+};
+
+// Shared by all units
+FrameCache frameCache;
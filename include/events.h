@@ -0,0 +1,55 @@
+// Most listeners of state changes (publisher, persistence, metrics, ...)
+#ifndef MAX_CHANGE_LISTENERS
+#define MAX_CHANGE_LISTENERS 4
+#endif
+
+/**
+ * Where a state change came from
+ */
+enum ChangeSource : uint8_t {
+  SOURCE_IR,    // remote control frame
+  SOURCE_MQTT,  // set message
+  SOURCE_COUNT
+};
+
+const char *const changeSourceNames[SOURCE_COUNT] = {"ir", "mqtt"};
+
+/**
+ * One state mutation of a unit: the changed fields and the state after it
+ */
+struct StateChange {
+  uint8_t unit;
+  ChangeSource source;
+  ChangeMask fields;
+  HvacState state;
+};
+
+typedef void (*ChangeListener)(const StateChange &change);
+
+/**
+ * State change bus
+ *
+ * Controllers emit one event per mutation that changed at least one field,
+ * listeners are called right away in the order they subscribed. Nothing
+ * is queued, so the listeners see every change in order and a loop without
+ * a mutation costs nothing.
+ */
+class ChangeBus {
+
+  private: ChangeListener listeners[MAX_CHANGE_LISTENERS];
+  private: uint8_t count = 0;
+
+  public: bool subscribe(ChangeListener listener) {
+    if (count >= MAX_CHANGE_LISTENERS)
+      return false;
+    listeners[count++] = listener;
+    return true;
+  }
+
+  public: void emit(const StateChange &change) {
+    for (uint8_t i = 0; i < count; i++)
+      listeners[i](change);
+  }
+};
+
+ChangeBus changeBus;
@@ -0,0 +1,96 @@
+// Recent sent and received frames to compare with
+#ifndef FINGERPRINT_RING
+#define FINGERPRINT_RING 8
+#endif
+
+// A received frame matching a sent one this recently is its echo (ms)
+#ifndef ECHO_WINDOW_MS
+#define ECHO_WINDOW_MS 1000
+#endif
+
+// A received frame matching a received one this recently is a repeat (ms)
+#ifndef REPEAT_WINDOW_MS
+#define REPEAT_WINDOW_MS 1000
+#endif
+
+/**
+ * Frame fingerprint (FNV-1a over the words)
+ */
+inline uint32_t frameFingerprint(const Frame &frame) {
+  uint16_t words[FRAME_WORDS];
+  HvacProtocol::toWords(frame, words);
+  uint32_t h = 2166136261UL;
+  for (uint8_t i = 0; i < FRAME_WORDS; i++)
+    h = (h ^ words[i]) * 16777619UL;
+  return h;
+}
+
+/**
+ * Echo and repeat filter
+ *
+ * Keeps the fingerprints of the last FINGERPRINT_RING frames sent or
+ * received, with the time they were seen. Received frames are
+ * fingerprinted once decoded and checked (the words as the classifier split
+ * them), and dropped before they are applied if the fingerprint is in the
+ * ring within its window: the echo of a frame from our own emitter, or the
+ * same remote frame again. Frames carry the whole state, so a repeat changes nothing
+ * unless a frame was sent in between, which ends the repeat windows.
+ */
+class FrameFilter {
+
+  private: struct Entry {
+    uint32_t fingerprint;
+    unsigned long at;  // millis()
+    bool sent;
+  };
+
+  private: Entry ring[FINGERPRINT_RING];
+  private: uint8_t next = 0;
+
+  public: uint32_t echoes = 0;
+  public: uint32_t repeats = 0;
+
+  public: FrameFilter() {
+    memset(ring, 0, sizeof(ring));
+  }
+
+  public: void noteSent(const Frame &frame) {
+    for (uint8_t i = 0; i < FINGERPRINT_RING; i++)
+      if (!ring[i].sent)
+        ring[i].at = 0;
+    note(frameFingerprint(frame), true);
+  }
+
+  /**
+   * True if a received frame has to be dropped, else it is noted
+   */
+  public: bool suppress(uint32_t fingerprint) {
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < FINGERPRINT_RING; i++) {
+      const Entry &entry = ring[i];
+      if (entry.fingerprint != fingerprint || entry.at == 0)
+        continue;
+      if (entry.sent && now - entry.at < ECHO_WINDOW_MS) {
+        echoes++;
+        return true;
+      }
+      if (!entry.sent && now - entry.at < REPEAT_WINDOW_MS) {
+        repeats++;
+        // A held button keeps repeating: the window runs from the last one
+        ring[i].at = now | 1;
+        return true;
+      }
+    }
+    note(fingerprint, false);
+    return false;
+  }
+
+  private: void note(uint32_t fingerprint, bool sent) {
+    ring[next].fingerprint = fingerprint;
+    ring[next].at = millis() | 1;  // 0: empty
+    ring[next].sent = sent;
+    next = (next + 1) % FINGERPRINT_RING;
+  }
+};
+
+FrameFilter frameFilter;
@@ -5,6 +5,7 @@
 #include <IRutils.h>
 #include <Time.h>
 #include <TimeLib.h>
+#include <type_traits>
 
 // Debug to serial
 #ifndef DEBUG_MODE
@@ -16,7 +17,7 @@
 #define MEMORY_MODE               true
 #endif
 
-// Default IR send GPIO pin
+// Default IR send GPIO pin (first unit)
 #ifndef SEND_PIN
 #define SEND_PIN                  15 // NodeMCU 15=D8
 #endif
@@ -26,655 +27,269 @@
 #define RECV_PIN                  14 // NodeMCU 14=D5
 #endif
 
-// IR signal features
-#define SEND_RATE_KHZ             38
+// Unit whose frames the receiver picks up (the remote carries no address)
+#ifndef RECV_UNIT
+#define RECV_UNIT                 0
+#endif
+
+// Serial speed
 #define BAUD_RATE                 115200
-#define CAPTURE_BUFFER_SIZE       1024
-#define TIMEOUT                   50U
-#define MIN_UNKNOWN_SIZE          12
 
-IRsend irsend(SEND_PIN);
-IRrecv irrecv(RECV_PIN, CAPTURE_BUFFER_SIZE, TIMEOUT, true);
+// Commands arriving within this window are sent as a single frame (ms)
+#ifndef COALESCE_WINDOW_MS
+#define COALESCE_WINDOW_MS        50
+#endif
 
-decode_results results;
-Memory memory;
+// IR hardware shared by all units
+Transmitter transmitter;
+Receiver receiver(RECV_PIN);
 
-struct List {
-  uint16_t data[197];
-  uint16_t counter = 0;
-};
+decode_results results;
 
 /**
- * Main controller
+ * Controller of one AC unit
+ * Protocol is a traits class (see zhjt03.h): its frames, commands and
+ * field codecs are compiled into the controller. The IR hardware, frame
+ * cache, classifier and duplicate filter are shared singletons built for
+ * HvacProtocol, so the controller is only instantiated with that one.
  */
+template <class Protocol>
 class HvacController {
 
-  private: HvacState defaultState;
-  public: HvacState state;
-  // TODO: Fix receive blocking when sending signal
-  public: bool isSending = false;
+  static_assert(std::is_same<Protocol, HvacProtocol>::value,
+    "the shared IR singletons speak HvacProtocol, select it with HVAC_PROTOCOL");
 
-  /**
-   * Converters
-   */
-
-  private: unsigned getTemperatureFromParameter(String param, unsigned temperature) {
-    // Split into temperature and mode codes
-    String tempCode = param;
-    String modeCode = param;
-    tempCode.setCharAt(1,'0');
-    tempCode.setCharAt(3,'0');
-    modeCode.setCharAt(0,'0');
-    modeCode.setCharAt(2,'0');
-
-    // Match temperature code
-    for (int i=0; i<16; i++)
-      if (tempCode.equalsIgnoreCase(temperatures[i])) {
-        temperature = i + 16;
-        // Exception if alt heat param is used, then temp is 32
-        if (modeCode.equalsIgnoreCase(CHIGO_PARAM_MODE_HEAT_ALT))
-          temperature += 16;
-        break;
-      }
+  // Host benchmark, replay and fleet tools drive the private stages directly
+  friend struct HvacBench;
+  friend struct HvacReplay;
+  friend struct HvacFleet;
 
-    return temperature;
-  }
+  public: typedef typename Protocol::Frame Frame;
+  public: typedef typename Protocol::Command Command;
 
-  private: unsigned getTimerDelayFromCode(String code, unsigned timerDelay) {
-    // unsigned timerDelay = 0;
-    
-    for (int i=0; i<25; i++)
-    {
-      if (code.equalsIgnoreCase(newTimerDelays[i]) || code.equalsIgnoreCase(oldTimerDelays[i]))
-        timerDelay = i;
-    }
-    return timerDelay;
-  }
-
-  private: bool getTimerStateFromCode(String code, boolean isSet) {
-    // boolean isSet = false;
-    
-    for (int i=0; i<25; i++)
-    {
-      if (code.equalsIgnoreCase(oldTimerDelays[i]))
-        isSet = true;
-    }
-    return isSet;
-  }
-
-  private: char* getExtraAsCode(bool turbo = false, bool hold = false) {
-    if (turbo && hold)
-      return CHIGO_EXTRA_TURBO_HOLD;
-    else if (turbo && !hold)
-      return CHIGO_EXTRA_TURBO;
-    else if (!turbo && hold)
-      return CHIGO_EXTRA_HOLD;
-    else 
-      return CHIGO_EXTRA_DEFAULT;
-  }
-
-  private: bool getTurboFromCode(String param) {
-    if (param.equalsIgnoreCase(CHIGO_EXTRA_TURBO_HOLD) || param.equalsIgnoreCase(CHIGO_EXTRA_TURBO))
-      return true;
-    else
-      return false;
+  private: uint8_t unit = 0;
+  private: Memory memory;
+  private: HvacState defaultState;
+  public: HvacState state;
+  private: HvacState reported;  // as of the last change event
+  private: Frame receivedFrame;  // last applied IR frame
+
+  // Command coalescing
+  private: HvacState sentState;
+  private: bool pending = false;
+  private: Command pendingCmd = Protocol::CMD_POWER;
+  private: unsigned long pendingSince = 0;
+  private: uint32_t pendingAt = 0;  // micros(), for tracing
+  public: uint32_t framesCoalesced = 0;
+
+  private: uint16_t long_space = Protocol::ONE_SPACE; // of the last decoded frame (us)
+  public: SpaceClassifier classifier;
+
+  // Header and footer: long timings are several times a long bit space,
+  // short ones are marks
+  private: char toBit(uint32_t usecs) {
+    return (usecs > (uint32_t)Protocol::LONG_FACTOR * long_space) ? '1' : '0';
   }
 
-  private: bool getHoldFromCode(String param) {
-    if (param.equalsIgnoreCase(CHIGO_EXTRA_TURBO_HOLD) || param.equalsIgnoreCase(CHIGO_EXTRA_HOLD))
-      return true;
-    else
-      return false;
+  // Framing timings from rawbuf[start] against a pattern of the protocol
+  private: bool matches(const decode_results *results, uint16_t start, const char *pattern) {
+    for (uint16_t i = 0; pattern[i]; i++)
+      if (toBit(results->rawbuf[start + i] * RAWTICK) != pattern[i])
+        return false;
+    return true;
   }
 
-  private: char* getPowerAsParameter(bool power) {
-    char *param = getCompositeSpeedAsParameter();
-    if (!power) {
-      char *swingMode;
-      switch(state.swing) {
-        case 0:
-          swingMode = (char*) CHIGO_PARAM_POWEROFF_SWING_0;
-        case 1:
-          swingMode = (char*) CHIGO_PARAM_POWEROFF_SWING_1;
-        case 2:
-          swingMode = (char*) CHIGO_PARAM_POWEROFF_SWING_2;
-        default:
-          swingMode = (char*) CHIGO_PARAM_POWEROFF_SWING_0;
+  /**
+   * Check IR data header and footer (timings and frame code)
+   * rawbuf[0] is the gap before the frame, the header mark follows.
+   */
+  public: bool verifyIRData(const decode_results *results, const Frame &frame)
+  {
+      uint16_t length = getCorrectedRawLength(results);
+      if (length < 1 + Protocol::RAW_LENGTH) {
+        if (DEBUG_MODE)
+          Serial.print("[DEBUG] Incomplete frame");
+        return false;
       }
-      
-      param[0] = swingMode[0];
-      param[2] = swingMode[2];
-    }
-    return param;
-  }
 
-  private: bool getPowerFromParameter(String param) {
-    // Remove insignificant pieces of information
-    param[1] = '0';
-    param[3] = '0';
-    if (
-      param.equalsIgnoreCase(CHIGO_PARAM_POWEROFF_SWING_0) ||
-      param.equalsIgnoreCase(CHIGO_PARAM_POWEROFF_SWING_1) ||
-      param.equalsIgnoreCase(CHIGO_PARAM_POWEROFF_SWING_2)
-      )
-    {
-      return false;
-    }
-    else
-      return true;
-  }
-
-  private: char* getModeAsParameter(Mode mode) {
-    switch (mode) {
-      case Auto:
-        return CHIGO_PARAM_MODE_AUTO;
-      case Cool:
-        if (state.temperature == 32)
-          return CHIGO_PARAM_MODE_COOL_ALT;
-        else
-          return CHIGO_PARAM_MODE_COOL;
-      case Dry:
-        return CHIGO_PARAM_MODE_DRY;
-      case Heat:
-        if (state.temperature == 32)
-          return CHIGO_PARAM_MODE_HEAT_ALT;
-        else
-          return CHIGO_PARAM_MODE_HEAT;
-      case Fan:
-        if (state.temperature == 32)
-          return CHIGO_PARAM_MODE_FAN_ALT;
-        else
-          return CHIGO_PARAM_MODE_FAN;
-    }
-  }
-
-  private: Mode getModeFromParameter(String param, Mode previousMode) {
-    // Remove temperature code
-    param.setCharAt(0, '0');
-    param.setCharAt(2, '0');
-    if (param.equalsIgnoreCase(CHIGO_PARAM_MODE_AUTO))
-      return Auto;
-    if (param.equalsIgnoreCase(CHIGO_PARAM_MODE_COOL) || param.equalsIgnoreCase(CHIGO_PARAM_MODE_COOL_ALT))
-      return Cool;
-    if (param.equalsIgnoreCase(CHIGO_PARAM_MODE_DRY))
-      return Dry;
-    if (param.equalsIgnoreCase(CHIGO_PARAM_MODE_HEAT) || param.equalsIgnoreCase(CHIGO_PARAM_MODE_HEAT_ALT))
-      return Heat;
-    if (param.equalsIgnoreCase(CHIGO_PARAM_MODE_FAN) || param.equalsIgnoreCase(CHIGO_PARAM_MODE_FAN_ALT))
-      return Fan;
-    return previousMode;
-  }
-
-  private: char* getSpeedAsParameter(Speed airSpeed, bool airFlow) {
-    if (airFlow) {
-      switch (airSpeed) {
-        case Slow:
-          return CHIGO_PARAM_SPEED_AF_SLOW;
-        case Medium:
-          return CHIGO_PARAM_SPEED_AF_MEDIUM;
-        case Fast:
-          return CHIGO_PARAM_SPEED_AF_FAST;
-        case Smart:  
-          return CHIGO_PARAM_SPEED_AF_SMART;
-      }
-    }
-    else {
-      switch (airSpeed) {
-        case Slow:
-          return CHIGO_PARAM_SPEED_SLOW;
-        case Medium:
-          return CHIGO_PARAM_SPEED_MEDIUM;
-        case Fast:
-          return CHIGO_PARAM_SPEED_FAST;
-        case Smart:  
-          return CHIGO_PARAM_SPEED_SMART;
+      if (!matches(results, 1, Protocol::HEADER_PATTERN)) {
+        if (DEBUG_MODE)
+          Serial.print("[DEBUG] Incorrect header");
+        return false;
       }
-    }
-  }
 
-  private: Speed getSpeedFromParameter(String param) {
-    // Remove 'swing' component from param
-    param[0] = '0';
-    param[2] = '0';
-
-    // Interpret speed
-    if (param.equalsIgnoreCase(CHIGO_PARAM_SPEED_SLOW) || param.equalsIgnoreCase(CHIGO_PARAM_SPEED_AF_SLOW)) {
-      return Slow;
-    }
-      
-    if (param.equalsIgnoreCase(CHIGO_PARAM_SPEED_MEDIUM) || param.equalsIgnoreCase(CHIGO_PARAM_SPEED_AF_MEDIUM)) {
-      return Medium;
-    }
-      
-    if (param.equalsIgnoreCase(CHIGO_PARAM_SPEED_FAST) || param.equalsIgnoreCase(CHIGO_PARAM_SPEED_AF_FAST)) {
-      return Fast;
-    }
-      
-    if (param.equalsIgnoreCase(CHIGO_PARAM_SPEED_SMART) || param.equalsIgnoreCase(CHIGO_PARAM_SPEED_AF_SMART)) {
-      return Smart;
-    }
-  }
-
-  private: bool getAirFlowFromParameter(String param) {
-    // Remove 'swing' component from param
-    param[0] = '0';
-    param[2] = '0';
-
-    if (
-      param.equalsIgnoreCase(CHIGO_PARAM_SPEED_AF_SLOW) || 
-      param.equalsIgnoreCase(CHIGO_PARAM_SPEED_AF_MEDIUM) || 
-      param.equalsIgnoreCase(CHIGO_PARAM_SPEED_AF_FAST) || 
-      param.equalsIgnoreCase(CHIGO_PARAM_SPEED_AF_SMART))
-    {
-      return true;
-    }
-    else {
-      return false;
-    }
-  }
-
-  private: char* getSwingAsParameter(unsigned swing, bool sleepMode) {
-    if (sleepMode) {
-      switch (swing) {
-        case 0:
-          return CHIGO_PARAM_SWING_SLEEP_0;
-        case 1:
-          return CHIGO_PARAM_SWING_SLEEP_1;
-        case 2:
-          return CHIGO_PARAM_SWING_SLEEP_2;
+      uint16_t footer_start = length - (sizeof(Protocol::FOOTER_PATTERN) - 1);
+      if (!matches(results, footer_start, Protocol::FOOTER_PATTERN)) {
+        if (DEBUG_MODE)
+          Serial.print("[DEBUG] Incorrect footer");
+        return false;
       }
-    }
-    else {
-      switch (swing) {
-        case 0:
-          return CHIGO_PARAM_SWING_0;
-        case 1:
-          return CHIGO_PARAM_SWING_1;
-        case 2:
-          return CHIGO_PARAM_SWING_2;
-      }
-    }
-  }
-
-  private: unsigned getSwingFromParameter(String param) {
-    // Remove 'speed' component from param
-    param[1] = '0';
-    param[3] = '0';
 
-    // Interpret swing mode
-    if (param.equalsIgnoreCase(CHIGO_PARAM_SWING_0))
-      return 0;
-    else if (param.equalsIgnoreCase(CHIGO_PARAM_SWING_1))
-      return 1;
-    else if (param.equalsIgnoreCase(CHIGO_PARAM_SWING_2))
-      return 2;
-    else
-      return 0;
-  }
-
-  // Get output parameter from swing, speed and air flow
-  private: char* getCompositeSpeedAsParameter() {
-    String airSpeedComponent = getSpeedAsParameter(state.airSpeed, state.airFlow);
-    String swingComponent = getSwingAsParameter(state.swing, state.sleepMode);
-    char compositeSpeed[5];
-    compositeSpeed[0] = swingComponent.charAt(0);
-    compositeSpeed[1] = airSpeedComponent.charAt(1);
-    compositeSpeed[2] = swingComponent.charAt(2);
-    compositeSpeed[3] = airSpeedComponent.charAt(3);
-    return compositeSpeed;
-  }
-
-  private: bool getSleepModeFromParameter(String param) {
-    // Remove 'speed' component from param
-    param[1] = '0';
-    param[3] = '0';
+      if (!Protocol::isIntact(frame)) {
+        if (DEBUG_MODE)
+          Serial.print("[DEBUG] Incorrect frame code");
+        return false;
+      }
 
-    if (
-      param.equalsIgnoreCase(CHIGO_PARAM_SWING_SLEEP_0) || 
-      param.equalsIgnoreCase(CHIGO_PARAM_SWING_SLEEP_1) || 
-      param.equalsIgnoreCase(CHIGO_PARAM_SWING_SLEEP_2)
-      )
-    {
       return true;
-    }
-    else {
-      return false;
-    }
-  }
-
-  private: uint16_t bit_threshold = 1000;
-  private: uint16_t header_len = 4;
-  private: uint16_t footer_len = 2;
-
-  private: char toBit(uint32_t usecs) {
-    return (usecs > bit_threshold) ? '1' : '0';
   }
 
   /**
-   * Check IR data header and footer
+   * Decode series of raw signals straight into a packed frame
+   * (no heap, no hex round trip). Returns false if the body is too short.
    */
-  public: bool verifyIRData(const decode_results *results)
+  public: bool decodeIRData(const decode_results *results, Frame &frame)
   {
-      uint16_t footer_start = getCorrectedRawLength(results) - footer_len + 1;
-      uint32_t usecs;
-
-      // Check header (2 bits in 4 signals)
-      char header[] = "1010";
-      for (int i = 0; i < header_len; i++) {
-        usecs = results->rawbuf[i] * RAWTICK;
-        if (header[i] == toBit(usecs)) {
-          if (DEBUG_MODE)
-            Serial.print("[DEBUG] Incorrect header");
-          return false;
-        }
+      uint16_t length = getCorrectedRawLength(results);
+      if (length < Protocol::HEADER_LENGTH + Protocol::FOOTER_LENGTH)
+        return false;
+      uint16_t body_end = min(length - Protocol::FOOTER_LENGTH, Protocol::HEADER_LENGTH + Protocol::WORDS * 16 * 2);
+
+      // Every second tick (LOW) carries one bit
+      uint8_t bits = (body_end - Protocol::HEADER_LENGTH + 1) / 2;
+      if (bits < Protocol::WORDS * 16) {
+        if (DEBUG_MODE)
+          Serial.printf("[DEBUG] Incomplete body (%d bits)\n", bits);
+        return false;
       }
 
-      // Check footer (2 bits in 3 signals)
-      char footer[] = "010";
-      for (int i = 0; i < footer_len+1; i++) {
-        usecs = results->rawbuf[i+footer_start] * RAWTICK;
-        if (footer[i] == toBit(usecs)) {
-          if (DEBUG_MODE)
-            Serial.print("[DEBUG] Incorrect footer");
-          return false;
-        }
-      }
+      // Split short and long spaces where this frame's clusters are
+      uint16_t words[Protocol::WORDS];
+      SpaceClusters clusters = classifier.decode(results->rawbuf, Protocol::HEADER_LENGTH, Protocol::WORDS * 16, words);
+      long_space = clusters.longMean;
+      if (DEBUG_MODE)
+        Serial.printf("[DEBUG] Space threshold %u us (%u/%u us, confidence %u%%)\n",
+          clusters.threshold, clusters.shortMean, clusters.longMean, clusters.confidence);
 
+      frame = Protocol::fromWords(words);
       return true;
   }
 
   /**
-   * Decode series of raw signals to hex code
+   * Check if the IR code has been received
+   * Returns true if a frame was decoded and applied.
    */
-  public: String decodeIRData(const decode_results *results)
+  public: bool checkIR()
   {
-      String bits; // output string (temp)
-      uint16_t body_end = getCorrectedRawLength(results) - footer_len;
-      uint32_t usecs;
-
-      // Print received bits (command only)
-      if (DEBUG_MODE) {
-        Serial.print("[DEBUG] Received command (BIN): ");
-        for (int i = header_len; i < body_end; i+=2) {
-          usecs = results->rawbuf[i] * RAWTICK;
-          bool val = (usecs > bit_threshold) ? 1 : 0;
-          Serial.print(val);
-        }
-        Serial.println();
+    if (receiver.decode(&results)) {
+      // Ignore our own transmissions
+      if (transmitter.receiveBlocked()) {
+        if (DEBUG_MODE)
+          Serial.println("[DEBUG] Ignored IR signal while sending");
+        receiver.resume();
+        return false;
       }
 
-      // Iterate over data (skip header, footer) and convert
-      // every 8 datapoints (4 * LOW+HIGH) into an integer code      
-      for (int i = header_len; i < body_end; i+=8) {
-          char code_str[5]; // 4 digits
-          for (int j = 0; j < 7; j+=2)
-          {
-            usecs = results->rawbuf[i+j] * RAWTICK; // check every second tick pair-wise
-            code_str[j/2] = (usecs > bit_threshold) ? '1' : '0'; // If second bit is over threshold, treat as 1 or 0
-          }
-          uint16_t code = strtol(code_str,0,2); // convert 4-bit binary string to int
-          bits += String(code, HEX); // append to string (temp)
-      };
-      return bits;
-  }
+      Frame frame;
+      bool valid = decodeIRData(&results, frame) && verifyIRData(&results, frame);
 
-  /**
-   * Check if the IR code has been received.
-   */
-  public: HvacState checkIR()
-  {
-    if (!this->isSending && irrecv.decode(&results)) {
-      if (results.overflow)
-      {
-        Serial.printf("[WARNING] IR code exceeds buffer (>= %d). ", CAPTURE_BUFFER_SIZE);
-        Serial.println();
+      // Late echoes of our own frames and repeated remote frames, by the
+      // decoded words (split where this frame's spaces are)
+      if (valid && frameFilter.suppress(frameFingerprint(frame))) {
+        if (DEBUG_MODE)
+          Serial.printf("[DEBUG] Suppressed IR frame (%u echoes, %u repeats)\n", frameFilter.echoes, frameFilter.repeats);
+        receiver.resume();
+        return false;
       }
 
-      if (verifyIRData(&results)) {
-        // Output the message body as HEX
-        receiveCommand(decodeIRData(&results));
+      if (IR_RECORDER)
+        recordCapture(&results);
+      receiver.resume();
+      if (valid) {
+        receivedFrame = frame;
+        receiveCommand(frame);
+        sentState = state;
+        if (IR_RECORDER)
+          recordState(state);
         yield();
-
-        // Update memory based on IR signal
-        if (MEMORY_MODE) {
-          updateMemory();
-        }
-      }
-
-      return state;
-    }
-  }
-
-  /**
-   * Encoding helpers
-   */
-
-  private: void addToList(List& data, unsigned int value) {
-    data.data[data.counter++] = value;
-  }
-
-  private: byte hexToByte(char hex) {
-    if (hex >= '0' && hex <= '9') {
-      return hex - '0';
-    }
-    return hex - 'A' + 10;
-  }
-
-  private: unsigned int highEndRawData[2] = {500, 1570};
-
-  private: void byteToRawData(byte bytee, List& data) {
-    for (int i = 3; i >= 0; --i) {
-      addToList(data, highEndRawData[0]);
-      addToList(data, highEndRawData[bitRead(bytee, i)]);
-    }
-  }
-
-  private: void addBytesToData(String bytes, size_t count, List& data) {
-    for (int i = 0; i < count; ++i) {
-      byteToRawData(hexToByte(bytes[i]), data);
-    }
-  }
-
-  private: void addHeaderToData(List& data) {
-    addToList(data, 6234);
-    addToList(data, 7302);
-  }
-
-  private: void addTimerToData(List& data) {
-    if (!state.timerSet && state.timerDelay == 0) {
-      // Skip timer header if delay hasn't changed      
-      addBytesToData(CHIGO_TIMER_SKIP, 4, data);
-    }
-    else if (state.timerSet && state.timerDelay > 0) {
-      // Use old delay header if timer was already set
-      addBytesToData(oldTimerDelays[state.timerDelay], 4, data);
-    }
-    else {
-      addBytesToData(newTimerDelays[state.timerDelay], 4, data);
-      if (state.timerDelay > 0) {
-        state.timerSet = true;
-        state.timerFrom = now();
-      }
-      else {
-        state.timerSet = false;
-        state.timerFrom = 0;
+        emitChange(SOURCE_IR);
       }
+      return valid;
     }
-  }
-
-  private: void addExtraToData(List& data) {
-    addBytesToData(getExtraAsCode(state.turbo, state.hold), 4, data);
-  }
 
-  private: void addCommandToData(String command, List& data) {
-    addBytesToData(command, 4, data);
+    return false;
   }
 
-  private: void addParameterToData(String parameter, List& data) {
-    addBytesToData(parameter, 4, data);
+  public: const Frame &lastFrame() {
+    return receivedFrame;
   }
 
-  private: void addTemperatureAndModeToData(int temp, String mode, List& data) {
-    unsigned int realTempIndex = temp - 16;
-    char tempAndMode[5] = {0};
-    strcpy(tempAndMode, temperatures[realTempIndex]);
+  /**
+   * Send a frame as is (e.g. from .../frame/set) and take the state it
+   * carries, as if it came from the remote. Replaces a pending command.
+   */
+  public: bool sendFrame(const Frame &frame) {
+    if (!Protocol::isValid(frame))
+      return false;
 
-    tempAndMode[1] = mode.charAt(1);
-    tempAndMode[3] = mode.charAt(3);
-    addBytesToData(tempAndMode, 4, data);
+    pending = false;
+    receiveCommand(frame);
+    sentState = state;
+    transmitter.send(unit, frame, state);
+    emitChange(SOURCE_MQTT);
+    return true;
   }
 
-  private: void addFooterToData(List& data) {
-    addBytesToData(CHIGO_FOOTER, 4, data);
-
-    addToList(data, 608);
-    addToList(data, 7372);
-    addToList(data, 616);
+  private: Frame buildFrame(Command cmd) {
+    return Protocol::encode(cmd, state);
   }
 
   public: void dumpState() {
-    Serial.println("[DEBUG] Current state");
+    Serial.printf("[DEBUG] Current state of unit %u\n", unit);
 
-    String power = state.power ? "on" : "off";
+    String power = state.power() ? "on" : "off";
     Serial.println("  power: " + power);
 
-    String turbo = state.turbo ? "on" : "off";
+    String turbo = state.turbo() ? "on" : "off";
     Serial.println("  turbo: " + turbo);
 
-    String hold = state.hold ? "on" : "off";
+    String hold = state.hold() ? "on" : "off";
     Serial.println("  hold: " + hold);
 
-    String sleepMode = state.sleepMode ? "on" : "off";
+    String sleepMode = state.sleepMode() ? "on" : "off";
     Serial.println("  sleep mode: " + sleepMode);
     
-    Serial.println("  temperature: " + String(state.temperature, DEC) + " C");
+    Serial.println("  temperature: " + String(state.temperature(), DEC) + " C");
 
     String modes[5] = {"auto", "cool", "dry", "heat", "fan"};
-    Serial.println("  mode: " + modes[state.mode]);
+    Serial.println("  mode: " + modes[state.mode()]);
 
     String fan_speeds[4] = {"slow", "medium", "fast", "smart"};
-    Serial.println("  speed: " + fan_speeds[state.airSpeed]);
+    Serial.println("  speed: " + fan_speeds[state.airSpeed()]);
 
-    String airFlow = state.airFlow ? "on" : "off";
+    String airFlow = state.airFlow() ? "on" : "off";
     Serial.println("  air flow: " + airFlow);
 
     String swing_modes[3] = {"horizontal", "fixed", "natural"};
-    Serial.println("  swing: " + swing_modes[state.swing]);
+    Serial.println("  swing: " + swing_modes[state.swing()]);
 
-    if (state.timerSet) {
-      Serial.println("  timer: " + String(state.timerDelay, DEC) + "h from " + String(state.timerFrom, DEC));
+    if (state.timerSet()) {
+      Serial.println("  timer: " + String(state.timerDelay(), DEC) + "h from " + String(state.timerFrom(), DEC));
     }
 
     Serial.println();
   }
 
-  private: void sendCommand(String cmd, char* param) {
-    List data;
-    addHeaderToData(data);
-
-    // TODO: implement Timers
-    // addTimerToData(data);
-    addBytesToData("FF00", 4, data);
-
-    // TODO: implement Extra modes
-    // addExtraToData(data);
-    addBytesToData("FF00", 4, data);
-
-    addCommandToData(cmd, data);
-    addParameterToData(param, data);
-    addTemperatureAndModeToData(state.temperature, getModeAsParameter(state.mode), data);
-    addFooterToData(data);
-    this->isSending = true;
-
-    if (DEBUG_MODE) {
-      // Print full IR signal (with header and footer)
-      Serial.print("[DEBUG] Sent IR signal: ");
-      for (int i=0; i<197; i++) {
-        Serial.print(data.data[i]);
-        Serial.print(",");
-      }
-      Serial.println();
-      // Print binary (command only)
-      Serial.print("[DEBUG] Sent command (BIN): ");
-      for (int i=3; i<195; i+=2) {
-        if (data.data[i] > 1000)
-          Serial.print(1);
-        else
-          Serial.print(0);
-      }
-      Serial.println();
-    }
-
-    irsend.sendRaw(data.data, data.counter, SEND_RATE_KHZ);
-    this->isSending = false;
+  private: void sendCommand(Command cmd) {
+    uint32_t started = micros();
+    Frame frame = buildFrame(cmd);
+    tracer.record(TRACE_BUILD, micros() - started);
+    // Dumped in debug mode by the transmitter, from the timings it sends
+    transmitter.send(unit, frame, state);
   }
 
-  private: void receiveCommand(String codes) {
-
-    // Extract individual codes
-    String timer = codes.substring(0,4);
-    String extra = codes.substring(4,8);
-    String cmd = codes.substring(8,12);
-    String param = codes.substring(12,16);
-    String temp_mode = codes.substring(16,20);
-    String footer = codes.substring(20,24);
+  private: void receiveCommand(const Frame &frame) {
 
     if (DEBUG_MODE) {
-      Serial.println("[DEBUG] Received command (HEX): " + timer + " " + extra + " " + cmd + " " + param + " " + temp_mode + " " + footer);
-    }
-    
-    // Set timer state
-    if (!timer.equalsIgnoreCase(CHIGO_TIMER_SKIP)) {
-
-      state.timerSet = getTimerStateFromCode(timer, state.timerSet);
-      state.timerDelay = getTimerDelayFromCode(timer, state.timerDelay);
-
-      // Add timer details if delay is new
-      if (state.timerDelay > 0 && !state.timerSet) {
-        state.timerFrom = now();
-        state.timerSet = true;
-      }
-
-      // Reset timer if no delay
-      if (state.timerDelay == 0) {
-        state.timerFrom = 0;
-        state.timerSet = false;
-      }
-    }
-    else {
-      state.timerDelay = 0;
-      state.timerFrom = 0;
-      state.timerSet = false;
+      uint16_t words[Protocol::WORDS];
+      Protocol::toWords(frame, words);
+      Serial.print("[DEBUG] Received command (HEX):");
+      for (uint8_t i = 0; i < Protocol::WORDS; i++)
+        Serial.printf(" %04X", words[i]);
+      Serial.println();
     }
 
-    // Set extra states
-    state.turbo = getTurboFromCode(extra);
-    state.hold = getHoldFromCode(extra);
-
-    // Set power state
-    // assume "power on" if any other command than "power off"
-    state.power = true;
-    if (cmd.equalsIgnoreCase(CHIGO_CMD_POWER))
-      state.power = getPowerFromParameter(param);
-
-    // Set mode and temperature state (always)
-    state.mode = getModeFromParameter(temp_mode, state.mode);
-    state.temperature = getTemperatureFromParameter(temp_mode, state.temperature);
-
-    // Set air speed, air flow, swing and sleep state
-    // if command is passed
-    if (
-      cmd.equalsIgnoreCase(CHIGO_CMD_SPEED) ||
-      cmd.equalsIgnoreCase(CHIGO_CMD_AIRFLOW) ||
-      cmd.equalsIgnoreCase(CHIGO_CMD_SWING) ||
-      cmd.equalsIgnoreCase(CHIGO_CMD_SLEEP)
-      )
-    {
-      state.airSpeed = getSpeedFromParameter(param);
-      state.airFlow = getAirFlowFromParameter(param);
-      state.sleepMode = getSleepModeFromParameter(param);
-      state.swing = getSwingFromParameter(param);
-    }
+    Protocol::decode(frame, state);
 
    if (DEBUG_MODE)
     dumpState();
@@ -687,8 +302,8 @@ class HvacController {
 
   public: void update() {
     // Any device update has to be send along with "power on" signal
-    state.power = true;
-    sendCommand(CHIGO_CMD_POWER, getPowerAsParameter(state.power));
+    state.setPower(true);
+    queueCommand(Protocol::CMD_POWER);
   }
 
   public: void turnOn() {
@@ -698,13 +313,13 @@ class HvacController {
   }
 
   public: void turnOff() {
-    state.power = false;
-    sendCommand(CHIGO_CMD_POWER, getPowerAsParameter(state.power));
+    state.setPower(false);
+    queueCommand(Protocol::CMD_POWER);
   }
 
   public: void setModeTo(Mode mode) {
-    state.mode = mode;
-    state.power = true;
+    state.setMode(mode);
+    state.setPower(true);
 
     // Set default temperature in auto, fan and dry mode
     if (
@@ -713,104 +328,202 @@ class HvacController {
       mode == Dry
       )
     {
-      state.temperature = defaultState.temperature;
+      state.setTemperature(defaultState.temperature());
     }
 
-    sendCommand(CHIGO_CMD_MODE, getCompositeSpeedAsParameter());
+    queueCommand(Protocol::CMD_MODE);
   }
 
   public: void setTimerTo(unsigned timerDelay = 0) {
-    state.timerDelay = timerDelay;
-    state.timerSet = false;
+    state.setTimerDelay(timerDelay);
+    state.setTimerSet(false);
     update();
   }
 
   public: int unsigned getTemperature() {
-    return state.temperature;
+    return state.temperature();
   }
 
   public: void setTemperatureTo(int unsigned temperature) {
-    state.power = true;
-    if (temperature >= state.temperature) {
-      state.temperature = temperature;
-      sendCommand(CHIGO_CMD_TEMP_UP, getCompositeSpeedAsParameter());
-    }
-    else {
-      state.temperature = temperature;
-      sendCommand(CHIGO_CMD_TEMP_DOWN, getCompositeSpeedAsParameter());
-    }
+    state.setPower(true);
+    state.setTemperature(temperature);
+    // Direction is resolved against the last sent frame
+    queueCommand(Protocol::CMD_TEMP_UP);
   }
 
   public: void holdOn() {
-    state.hold = true;
+    state.setHold(true);
     update();
   }
 
   public: void holdOff() {
-    state.hold = false;
+    state.setHold(false);
     update();
   }
 
   public: void turboOn() {
-    state.turbo = true;
+    state.setTurbo(true);
     update();
   }
 
   public: void turboOff() {
-    state.turbo = false;
+    state.setTurbo(false);
     update();
   }
 
   public: void setAirFlowTo(bool airFlow) {
-    state.airFlow = airFlow;
-    state.power = true;
-    sendCommand(CHIGO_CMD_AIRFLOW, getCompositeSpeedAsParameter());
+    state.setAirFlow(airFlow);
+    state.setPower(true);
+    queueCommand(Protocol::CMD_AIRFLOW);
   }
 
   public: void setSpeedTo(Speed airSpeed) {
-    state.airSpeed = airSpeed;
-    state.power = true;
-    sendCommand(CHIGO_CMD_SPEED, getCompositeSpeedAsParameter());
+    state.setAirSpeed(airSpeed);
+    state.setPower(true);
+    queueCommand(Protocol::CMD_SPEED);
   }
 
   public: void setSwingTo(unsigned swing) {
-    state.swing = swing;
-    state.power = true;
-    sendCommand(CHIGO_CMD_SWING, getCompositeSpeedAsParameter());
+    state.setSwing(swing);
+    state.setPower(true);
+    queueCommand(Protocol::CMD_SWING);
   }
 
   public: void setSleepModeTo(bool sleepMode) {
-    state.sleepMode = sleepMode;
-    state.power = true;
-    sendCommand(CHIGO_CMD_SLEEP, getCompositeSpeedAsParameter());
+    state.setSleepMode(sleepMode);
+    state.setPower(true);
+    queueCommand(Protocol::CMD_SLEEP);
+  }
+
+  /**
+   * Take the given fields of target at once, sent as one (update) frame
+   * Same rules as the single setters: the unit is turned on unless power is
+   * among the fields, a new timer delay restarts the timer and auto, fan
+   * and dry mode bring the default temperature unless one is given.
+   */
+  public: void setStateTo(HvacState target, ChangeMask fields) {
+    if (!(fields & FIELD_POWER))
+      target.setPower(true);
+    if (fields & FIELD_TIMER)
+      target.setTimerSet(false);
+    if ((fields & FIELD_MODE) && !(fields & FIELD_TEMPERATURE) &&
+      (target.mode() == Auto || target.mode() == Fan || target.mode() == Dry))
+      target.setTemperature(defaultState.temperature());
+
+    state = target;
+    queueCommand(Protocol::CMD_POWER);
+  }
+
+  /**
+   * Coalescing
+   * Setters only mutate state and note the command. A single frame is sent
+   * when the window closes: every frame carries the whole state, so several
+   * commands are merged into a power (update) command.
+   */
+  private: void queueCommand(Command cmd) {
+    emitChange(SOURCE_MQTT);
+
+    if (!pending) {
+      pending = true;
+      pendingCmd = cmd;
+      pendingSince = millis();
+      pendingAt = micros();
+    }
+    else {
+      framesCoalesced++;
+      if (cmd != pendingCmd)
+        pendingCmd = Protocol::CMD_POWER;
+    }
+
+    if (COALESCE_WINDOW_MS == 0)
+      flushCommand();
   }
 
-  public: void updateMemory() {
-    memory.save(state);
+  private: void flushCommand() {
+    Command cmd = pendingCmd;
+    pending = false;
+
+    if (!state.power())
+      cmd = Protocol::CMD_POWER;
+    else if (cmd == Protocol::CMD_TEMP_UP && state.temperature() < sentState.temperature())
+      cmd = Protocol::CMD_TEMP_DOWN;
+
+    sendCommand(cmd);
+    sentState = state;
+    tracer.record(TRACE_COALESCE, micros() - pendingAt);
+
+    if (DEBUG_MODE)
+      Serial.printf("[DEBUG] Frames saved by coalescing: %u\n", framesCoalesced);
+
+    // Starting a timer stamps the state
+    emitChange(SOURCE_MQTT);
   }
 
-  public: void setup() {
-    // Start serial connection (for logging)
-    Serial.begin(BAUD_RATE, SERIAL_8N1, SERIAL_TX_ONLY);
-    delay(1000);
+  /**
+   * Announce the fields changed since the last event, if any
+   */
+  private: void emitChange(ChangeSource source) {
+    ChangeMask fields = diffState(state, reported);
+    if (!fields)
+      return;
+    reported = state;
+    changeBus.emit({unit, source, fields, state});
+  }
 
-    // Ignore messages with less than minimum on or off pulses.
-   irrecv.setUnknownThreshold(MIN_UNKNOWN_SIZE);
+  /**
+   * Mark changed fields for the write-behind memory (persistence listener)
+   */
+  public: void updateMemory(ChangeMask changes = FIELD_ALL) {
+    if (MEMORY_MODE)
+      memory.markDirty(changes);
+  }
 
-    // Start the receiver
-   irrecv.enableIRIn();
+  /**
+   * Write pending changes right away (before a planned restart, see
+   * restartNode() in the sketch)
+   */
+  public: void flushMemory() {
+    if (MEMORY_MODE && memory.isDirty())
+      memory.flush(state);
+  }
+
+  /**
+   * No IR frame is being sent, received or waiting to be decoded
+   */
+  private: bool isIRIdle() {
+    return !transmitter.receiveBlocked() && receiver.isIdle();
+  }
+
+  /**
+   * Send pending commands and flush memory (call on every loop, the shared
+   * transmitter is driven separately)
+   */
+  public: void loop() {
+    if (pending && millis() - pendingSince >= COALESCE_WINDOW_MS)
+      flushCommand();
+
+    if (MEMORY_MODE && memory.flushDue() && isIRIdle())
+      memory.flush(state);
+  }
 
-    // Start the sender
-    irsend.begin();
+  /**
+   * Take the unit's emitter and restore its state (the shared receiver and
+   * transmitter are started by the sketch)
+   */
+  public: void setup(uint8_t unitIndex = 0, uint8_t sendPin = SEND_PIN) {
+    unit = unitIndex;
+    transmitter.attach(unit, sendPin);
 
     // Initialize EEPROM
     if (MEMORY_MODE) {
-      memory.setup(state);
+      memory.setup(state, unit);
     }
+    sentState = state;
+    reported = state;
 
     // Dump state in debug mode
     if (DEBUG_MODE) {
       dumpState();
     }
   }
-};
+};
\ No newline at end of file
@@ -0,0 +1,207 @@
+// Most tokens (keys and values) of one JSON message
+#ifndef JSON_MAX_TOKENS
+#define JSON_MAX_TOKENS 24
+#endif
+
+enum JsonType : uint8_t {
+  JSON_STRING,
+  JSON_NUMBER,
+  JSON_TRUE,
+  JSON_FALSE,
+  JSON_NULL
+};
+
+/**
+ * Span of a key or value in the payload (strings without the quotes)
+ */
+struct JsonToken {
+  JsonType type;
+  uint16_t start;
+  uint16_t length;
+};
+
+/**
+ * Flat JSON object tokenizer
+ *
+ * Parses one object of scalar members ({"key": value, ...}) in place: the
+ * tokens point into the payload, which is neither copied nor changed, and
+ * their number is fixed (JSON_MAX_TOKENS). Nested objects, arrays and
+ * escaped strings are rejected, none of the commands need them.
+ */
+class JsonObject {
+
+  private: const byte *payload = NULL;
+  private: unsigned length = 0;
+  private: JsonToken tokens[JSON_MAX_TOKENS];  // key, value, key, value, ...
+  private: uint8_t count = 0;
+
+  public: bool parse(const byte *data, unsigned size) {
+    payload = data;
+    length = size;
+    count = 0;
+
+    unsigned i = skipSpace(0);
+    if (i >= length || payload[i] != '{')
+      return false;
+    i = skipSpace(i + 1);
+    if (i < length && payload[i] == '}')
+      return skipSpace(i + 1) == length;
+
+    while (true) {
+      if (count + 2 > JSON_MAX_TOKENS)
+        return false;
+      JsonToken &key = tokens[count++];
+      JsonToken &value = tokens[count++];
+
+      if (!readString(i, key))
+        return false;
+      i = skipSpace(i);
+      if (i >= length || payload[i] != ':')
+        return false;
+      i = skipSpace(i + 1);
+      if (!readValue(i, value))
+        return false;
+
+      i = skipSpace(i);
+      if (i >= length)
+        return false;
+      if (payload[i] == '}')
+        return skipSpace(i + 1) == length;
+      if (payload[i] != ',')
+        return false;
+      i = skipSpace(i + 1);
+    }
+  }
+
+  /**
+   * Number of members
+   */
+  public: uint8_t size() const {
+    return count / 2;
+  }
+
+  public: bool keyIs(uint8_t member, const char *key) const {
+    const JsonToken &token = tokens[2 * member];
+    return strlen(key) == token.length && memcmp(payload + token.start, key, token.length) == 0;
+  }
+
+  /**
+   * Value accessors, false if the value has another type or is out of range
+   */
+
+  public: bool getBool(uint8_t member, bool &value) const {
+    const JsonToken &token = tokens[2 * member + 1];
+    if (token.type != JSON_TRUE && token.type != JSON_FALSE)
+      return false;
+    value = token.type == JSON_TRUE;
+    return true;
+  }
+
+  // Integer part of a number, the fraction is truncated
+  public: bool getInt(uint8_t member, int &value) const {
+    const JsonToken &token = tokens[2 * member + 1];
+    if (token.type != JSON_NUMBER)
+      return false;
+
+    unsigned i = token.start;
+    unsigned end = token.start + token.length;
+    bool negative = payload[i] == '-';
+    if (negative)
+      i++;
+    unsigned digits = 0;
+    value = 0;
+    for (; i < end && payload[i] >= '0' && payload[i] <= '9'; i++) {
+      if (++digits > 6)
+        return false;
+      value = value * 10 + (payload[i] - '0');
+    }
+    if (negative)
+      value = -value;
+    return true;
+  }
+
+  // Index of a string value in values
+  public: bool getEnum(uint8_t member, const char *const *values, uint8_t valueCount, int &value) const {
+    const JsonToken &token = tokens[2 * member + 1];
+    if (token.type != JSON_STRING)
+      return false;
+    for (uint8_t i = 0; i < valueCount; i++)
+      if (strlen(values[i]) == token.length && memcmp(payload + token.start, values[i], token.length) == 0) {
+        value = i;
+        return true;
+      }
+    return false;
+  }
+
+  private: unsigned skipSpace(unsigned i) const {
+    while (i < length && (payload[i] == ' ' || payload[i] == '\t' || payload[i] == '\r' || payload[i] == '\n'))
+      i++;
+    return i;
+  }
+
+  private: bool readString(unsigned &i, JsonToken &token) const {
+    if (i >= length || payload[i] != '"')
+      return false;
+    unsigned start = ++i;
+    for (; i < length && payload[i] != '"'; i++)
+      if (payload[i] == '\\' || payload[i] < 0x20)
+        return false;
+    if (i >= length)
+      return false;
+    token.type = JSON_STRING;
+    token.start = start;
+    token.length = i++ - start;
+    return true;
+  }
+
+  private: bool readLiteral(unsigned &i, JsonToken &token, const char *literal, JsonType type) const {
+    size_t size = strlen(literal);
+    if (length - i < size || memcmp(payload + i, literal, size) != 0)
+      return false;
+    token.type = type;
+    token.start = i;
+    token.length = size;
+    i += size;
+    return true;
+  }
+
+  // -?digits(.digits)?, exponents are not needed
+  private: bool readNumber(unsigned &i, JsonToken &token) const {
+    unsigned start = i;
+    if (i < length && payload[i] == '-')
+      i++;
+    unsigned digits = i;
+    while (i < length && payload[i] >= '0' && payload[i] <= '9')
+      i++;
+    if (i == digits)
+      return false;
+    if (i < length && payload[i] == '.') {
+      unsigned fraction = ++i;
+      while (i < length && payload[i] >= '0' && payload[i] <= '9')
+        i++;
+      if (i == fraction)
+        return false;
+    }
+    token.type = JSON_NUMBER;
+    token.start = start;
+    token.length = i - start;
+    return true;
+  }
+
+  private: bool readValue(unsigned &i, JsonToken &token) const {
+    if (i >= length)
+      return false;
+    switch (payload[i]) {
+      case '"':
+        return readString(i, token);
+      case 't':
+        return readLiteral(i, token, "true", JSON_TRUE);
+      case 'f':
+        return readLiteral(i, token, "false", JSON_FALSE);
+      case 'n':
+        return readLiteral(i, token, "null", JSON_NULL);
+      default:
+        return readNumber(i, token);
+    }
+  }
+};
@@ -1,18 +1,52 @@
-#include <EEPROM.h>
-
-#define MEM_SIZE 12
-#define MEM_ADDR_TEMP 0
-#define MEM_ADDR_MODE 1
-#define MEM_ADDR_SPEED 2
-#define MEM_ADDR_AIRFLOW 3
-#define MEM_ADDR_SLEEP 4
-#define MEM_ADDR_SWING 5
-#define MEM_ADDR_POWER 6
-#define MEM_ADDR_TURBO 7
-#define MEM_ADDR_HOLD 8
-#define MEM_ADDR_TIMER_SET 9
-#define MEM_ADDR_TIMER_DELAY 10
-#define MEM_ADDR_TIMER_FROM 11
+#ifdef ARDUINO_ARCH_ESP8266
+#include <spi_flash.h>
+extern "C" uint32_t _EEPROM_start;
+extern "C" uint32_t _FS_start;
+extern "C" uint32_t _FS_end;
+#endif
+
+// The journal takes the end of the file system area, which must not be used
+#ifdef FS_H
+#error "The state journal (memory.h) overlaps the file system area, which is in use"
+#endif
+
+// Flash sectors used by the state journal of each unit
+// Units get consecutive regions that end with the EEPROM sector. The ones
+// before it are the gap boards.txt.py leaves when it rounds the end of the
+// file system area down to the FS block size (one sector on the 4 MB
+// NodeMCU layouts), then the end of the (unused) file system area.
+#ifndef JOURNAL_SECTORS
+#define JOURNAL_SECTORS 2
+#endif
+
+#ifdef ARDUINO_ARCH_ESP8266
+#define FLASH_SECTOR(symbol) ((uint32_t)((uintptr_t)&(symbol) - 0x40200000) / SPI_FLASH_SEC_SIZE)
+#define EEPROM_SECTOR FLASH_SECTOR(_EEPROM_start)
+#endif
+
+#ifndef JOURNAL_FIRST_SECTOR
+#define JOURNAL_FIRST_SECTOR (EEPROM_SECTOR - (JOURNAL_SECTORS * HVAC_UNITS - 1))
+#endif
+
+// Host builds: the journal ends in the EEPROM sector as on the device
+#ifndef EEPROM_SECTOR
+#define EEPROM_SECTOR (JOURNAL_FIRST_SECTOR + JOURNAL_SECTORS * HVAC_UNITS - 1)
+#endif
+
+#define JOURNAL_RECORD_SIZE 16
+#define JOURNAL_SLOTS_PER_SECTOR (SPI_FLASH_SEC_SIZE / JOURNAL_RECORD_SIZE)
+#define JOURNAL_SLOTS (JOURNAL_SECTORS * JOURNAL_SLOTS_PER_SECTOR)
+#define JOURNAL_EMPTY 0xFFFFFFFFUL
+
+// Write-behind: flush after this long without changes (ms)
+#ifndef MEMORY_QUIET_MS
+#define MEMORY_QUIET_MS 3000
+#endif
+
+// Write-behind: never keep changes unsaved for longer than this (ms)
+#ifndef MEMORY_MAX_STALENESS_MS
+#define MEMORY_MAX_STALENESS_MS 30000
+#endif
 
 // Debug to serial
 #ifndef DEBUG_MODE
@@ -24,87 +58,347 @@
 #define MEMORY_INIT false
 #endif
 
+/**
+ * Sequence-numbered, CRC protected state record
+ */
+struct JournalRecord {
+  uint32_t sequence;
+  uint32_t bits;
+  uint32_t timerFrom;
+  uint16_t reserved;
+  uint16_t crc;
+};
+
+static_assert(sizeof(JournalRecord) == JOURNAL_RECORD_SIZE, "Unexpected journal record size");
+
+/**
+ * State as the former EEPROM memory stored it (one byte per field, from
+ * the start of the EEPROM sector). The power byte was written with the
+ * turbo flag, the timer start with its low byte only.
+ */
+#define LEGACY_SIZE 12
+#define LEGACY_TEMP 0
+#define LEGACY_MODE 1
+#define LEGACY_SPEED 2
+#define LEGACY_AIRFLOW 3
+#define LEGACY_SLEEP 4
+#define LEGACY_SWING 5
+#define LEGACY_POWER 6
+#define LEGACY_TURBO 7
+#define LEGACY_HOLD 8
+#define LEGACY_TIMER_SET 9
+#define LEGACY_TIMER_DELAY 10
+
+/**
+ * Log-structured state journal
+ *
+ * Records are appended to a ring of flash slots. A sector is only erased
+ * when the ring wraps into it, so the other sectors keep the previous
+ * records if power is lost in between. Every unit has its own ring.
+ */
 class Memory {
+ private:
+  uint32_t firstSector = JOURNAL_FIRST_SECTOR;
+  bool usable = true;
+  uint32_t sequence = 0;
+  uint16_t nextSlot = 0;
+  JournalRecord last;
+  bool hasRecord = false;
+  ChangeMask dirty = 0;
+  unsigned long dirtySince = 0;
+  unsigned long changedAt = 0;
+
+ public:
+  uint32_t erases = 0;
+  uint32_t writes = 0;
+  uint32_t flushes = 0;
+
  public:
-  void setup(HvacState &state) {
-    EEPROM.begin(MEM_SIZE);
+  void setup(HvacState &state, uint8_t unit = 0) {
+    firstSector = JOURNAL_FIRST_SECTOR + unit * JOURNAL_SECTORS;
+
+    usable = fitsFlashLayout();
+    if (!usable) {
+      Serial.printf("[MEMORY] Error: journal of unit %u (sectors %u-%u) is outside the free flash before the EEPROM sector, state is not saved\n",
+        unit, firstSector, firstSector + JOURNAL_SECTORS - 1);
+      return;
+    }
 
     // Clear memory if initialization mode
     if (MEMORY_INIT) {
-      Serial.print("[INIT] Clearing EEPROM memory");
-      for (int i = 0; i < MEM_SIZE; ++i) {
-        EEPROM.write(i, 0);
+      Serial.printf("[INIT] Clearing journal of unit %u", unit);
+      for (int i = 0; i < JOURNAL_SECTORS; ++i) {
+        eraseSector(i);
         Serial.print(".");
       }
-      EEPROM.commit();
-      delay(100);
       Serial.println("done!");
       Serial.println("Re-upload sketch without MEMORY_INIT flag");
     }
 
+    recover();
+
+    // Former EEPROM state, moved into the first unit's journal if that has
+    // no record yet
+    HvacState legacy = state;
+    if (unit == 0 && !MEMORY_INIT && !hasRecord && takeLegacy(legacy)) {
+      Serial.println("[MEMORY] Restored state from the former EEPROM memory");
+      recover();
+      save(legacy);
+    }
+
     // Read memory to state
     read(state);
   }
 
+  /**
+   * The journal regions lie between the start of the file system area and
+   * the EEPROM sector, which comes after the file system area and its gap
+   */
+ private:
+  static bool fitsFlashLayout() {
+#ifdef ARDUINO_ARCH_ESP8266
+    uint32_t fsStart = FLASH_SECTOR(_FS_start);
+    uint32_t fsEnd = FLASH_SECTOR(_FS_end);
+    return fsStart <= fsEnd && fsEnd <= EEPROM_SECTOR && JOURNAL_FIRST_SECTOR >= fsStart &&
+      JOURNAL_FIRST_SECTOR + JOURNAL_SECTORS * HVAC_UNITS - 1 <= EEPROM_SECTOR;
+#else
+    return true;
+#endif
+  }
+
+  /**
+   * Read the former EEPROM state and erase its sector
+   * Only an untouched EEPROM image is taken: no valid journal record in the
+   * first slot (the sector may belong to another unit's journal), the
+   * fields in range, the rest of the first slot and the next slot erased
+   * (a journal record always writes its CRC there).
+   */
+ private:
+  bool takeLegacy(HvacState &state) {
+    uint32_t words[JOURNAL_RECORD_SIZE * 2 / 4];
+    ESP.flashRead(EEPROM_SECTOR * SPI_FLASH_SEC_SIZE, words, sizeof(words));
+    const uint8_t *bytes = (const uint8_t*)words;
+
+    JournalRecord record;
+    memcpy(&record, words, sizeof(record));
+    if (isValid(record))
+      return false;
+
+    for (uint8_t i = LEGACY_SIZE; i < sizeof(words); i++)
+      if (bytes[i] != 0xFF)
+        return false;
+    if (bytes[LEGACY_TEMP] < CHIGO_TEMP_MIN || bytes[LEGACY_TEMP] > CHIGO_TEMP_MAX ||
+      bytes[LEGACY_MODE] > Fan || bytes[LEGACY_SPEED] > Smart || bytes[LEGACY_SWING] > 2 ||
+      bytes[LEGACY_TIMER_DELAY] > 24)
+      return false;
+    const uint8_t flags[] = {LEGACY_AIRFLOW, LEGACY_SLEEP, LEGACY_POWER, LEGACY_TURBO, LEGACY_HOLD, LEGACY_TIMER_SET};
+    for (uint8_t flag : flags)
+      if (bytes[flag] > 1)
+        return false;
+
+    state.setTemperature(bytes[LEGACY_TEMP]);
+    state.setMode((Mode)bytes[LEGACY_MODE]);
+    state.setAirSpeed((Speed)bytes[LEGACY_SPEED]);
+    state.setAirFlow(bytes[LEGACY_AIRFLOW]);
+    state.setSleepMode(bytes[LEGACY_SLEEP]);
+    state.setSwing(bytes[LEGACY_SWING]);
+    state.setPower(bytes[LEGACY_POWER]);
+    state.setTurbo(bytes[LEGACY_TURBO]);
+    state.setHold(bytes[LEGACY_HOLD]);
+    state.setTimerSet(bytes[LEGACY_TIMER_SET]);
+    state.setTimerDelay(bytes[LEGACY_TIMER_DELAY]);
+    state.setTimerFrom(0);
+
+    // The sector belongs to the last unit's journal from now on
+    ESP.flashEraseSector(EEPROM_SECTOR);
+    erases++;
+    return true;
+  }
+
  private:
-  void writeInt(int p, int value) {
-    if (EEPROM.read(p) != lowByte(value)) EEPROM.write(p, lowByte(value));
+  uint32_t slotAddress(uint16_t slot) {
+    return (firstSector * SPI_FLASH_SEC_SIZE) + slot * JOURNAL_RECORD_SIZE;
   }
 
  private:
-  void writeBool(int p, bool value) {
-    if (EEPROM.read(p) != (byte)value) EEPROM.write(p, (byte)value);
+  void readSlot(uint16_t slot, JournalRecord &record) {
+    ESP.flashRead(slotAddress(slot), (uint32_t*)&record, sizeof(record));
   }
 
  private:
-  void dumpMemory() {
-    Serial.print("[DEBUG] Memory dump: ");
-    for (int i = 0; i < MEM_SIZE; ++i) {
-      Serial.print(String(EEPROM.read(i)) + ",");
+  uint32_t readSequence(uint16_t slot) {
+    uint32_t value = JOURNAL_EMPTY;
+    ESP.flashRead(slotAddress(slot), &value, sizeof(value));
+    return value;
+  }
+
+ private:
+  void eraseSector(uint16_t sector) {
+    ESP.flashEraseSector(firstSector + sector);
+    erases++;
+  }
+
+ private:
+  static uint16_t crc16(const uint8_t *data, size_t length) {
+    uint16_t crc = 0xFFFF; // CRC-16/CCITT
+    for (size_t i = 0; i < length; i++) {
+      crc ^= (uint16_t)data[i] << 8;
+      for (int b = 0; b < 8; b++)
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
     }
-    Serial.println();
+    return crc;
+  }
+
+ private:
+  static uint16_t checksum(JournalRecord record) {
+    record.crc = 0;
+    return crc16((const uint8_t*)&record, sizeof(record));
+  }
+
+ private:
+  bool isValid(const JournalRecord &record) {
+    return record.sequence != JOURNAL_EMPTY && record.crc == checksum(record);
   }
 
   /**
-   * Save current state in EEPROM
+   * Find the newest valid record
+   * Every sector is filled front to back, so the current sector is the one
+   * whose first record is newest and its last written slot is found with
+   * a binary search. Torn writes (bad CRC) fall back to older records.
+   */
+ private:
+  void recover() {
+    int current = -1;
+    uint32_t newest = 0;
+    for (int i = 0; i < JOURNAL_SECTORS; ++i) {
+      uint32_t first = readSequence(i * JOURNAL_SLOTS_PER_SECTOR);
+      if (first != JOURNAL_EMPTY && (current < 0 || first > newest)) {
+        current = i;
+        newest = first;
+      }
+    }
+
+    hasRecord = false;
+    if (current < 0) {
+      nextSlot = 0;
+      sequence = 0;
+      return;
+    }
+
+    uint16_t low = current * JOURNAL_SLOTS_PER_SECTOR;
+    uint16_t high = low + JOURNAL_SLOTS_PER_SECTOR - 1;
+    while (low < high) {
+      uint16_t mid = (low + high + 1) / 2;
+      if (readSequence(mid) != JOURNAL_EMPTY)
+        low = mid;
+      else
+        high = mid - 1;
+    }
+
+    // Never write over a used slot, even if it is torn
+    sequence = readSequence(low);
+    nextSlot = (low + 1) % JOURNAL_SLOTS;
+
+    for (uint16_t i = 0; i < JOURNAL_SLOTS; ++i) {
+      uint16_t slot = (low + JOURNAL_SLOTS - i) % JOURNAL_SLOTS;
+      readSlot(slot, last);
+      if (isValid(last)) {
+        hasRecord = true;
+        if (last.sequence > sequence)
+          sequence = last.sequence;
+        break;
+      }
+    }
+  }
+
+ private:
+  void dumpMemory() {
+    Serial.printf("[DEBUG] Journal: seq %u, next slot %u, %u writes, %u erases\n",
+      sequence, nextSlot, writes, erases);
+  }
+
+  /**
+   * Save current state in the journal
    */
  public:
-  void save(HvacState state) {
-    writeInt(MEM_ADDR_TEMP, (int)state.temperature);
-    writeInt(MEM_ADDR_MODE, (int)state.mode);
-    writeInt(MEM_ADDR_SPEED, (int)state.airSpeed);
-    writeBool(MEM_ADDR_AIRFLOW, state.airFlow);
-    writeBool(MEM_ADDR_SLEEP, state.sleepMode);
-    writeInt(MEM_ADDR_SWING, (int)state.swing);
-    writeBool(MEM_ADDR_POWER, state.power);
-    writeBool(MEM_ADDR_POWER, state.turbo);
-    writeBool(MEM_ADDR_HOLD, state.hold);
-    writeBool(MEM_ADDR_TIMER_SET, state.timerSet);
-    writeInt(MEM_ADDR_TIMER_DELAY, (int)state.timerDelay);
-    writeInt(MEM_ADDR_TIMER_FROM, (int)state.timerFrom);
-    EEPROM.commit();
-    delay(100);
+  void save(const HvacState &state) {
+    JournalRecord record;
+    record.sequence = sequence + 1;
+    record.bits = state.bits;
+    record.timerFrom = state.timerFrom();
+    record.reserved = 0xFFFF;
+    record.crc = checksum(record);
+
+    // Skip writing if nothing changed
+    if (hasRecord && record.bits == last.bits && record.timerFrom == last.timerFrom)
+      return;
+
+    uint32_t started = micros();
+
+    // Entering a new sector: erase it (only happens when the ring wraps)
+    if (nextSlot % JOURNAL_SLOTS_PER_SECTOR == 0 && readSequence(nextSlot) != JOURNAL_EMPTY)
+      eraseSector(nextSlot / JOURNAL_SLOTS_PER_SECTOR);
+
+    ESP.flashWrite(slotAddress(nextSlot), (uint32_t*)&record, sizeof(record));
+    writes++;
+    tracer.record(TRACE_SAVE, micros() - started);
+
+    sequence = record.sequence;
+    nextSlot = (nextSlot + 1) % JOURNAL_SLOTS;
+    last = record;
+    hasRecord = true;
     if (DEBUG_MODE) dumpMemory();
   }
 
   /**
-   * Read current state in EEPROM
+   * Write-behind scheduling
+   * Changes only mark fields dirty, the journal is written once they have
+   * settled for MEMORY_QUIET_MS or are MEMORY_MAX_STALENESS_MS old.
+   */
+ public:
+  void markDirty(ChangeMask changes) {
+    if (!changes)
+      return;
+    changedAt = millis();
+    if (!dirty)
+      dirtySince = changedAt;
+    dirty |= changes;
+  }
+
+ public:
+  bool isDirty() {
+    return dirty != 0;
+  }
+
+ public:
+  bool flushDue() {
+    if (!dirty || !usable)
+      return false;
+    unsigned long now = millis();
+    return now - changedAt >= MEMORY_QUIET_MS || now - dirtySince >= MEMORY_MAX_STALENESS_MS;
+  }
+
+ public:
+  void flush(const HvacState &state) {
+    if (!usable)
+      return;
+    if (DEBUG_MODE)
+      Serial.printf("[DEBUG] Flushing memory (dirty 0x%08X, %lu ms old)\n", dirty, millis() - dirtySince);
+    save(state);
+    dirty = 0;
+    flushes++;
+  }
+
+  /**
+   * Read current state from the journal
    */
  public:
   void read(HvacState &state) {
     if (DEBUG_MODE) dumpMemory();
+    if (!hasRecord)
+      return;
 
-    state.temperature = EEPROM.read(MEM_ADDR_TEMP);
-    state.mode = (Mode)EEPROM.read(MEM_ADDR_MODE);
-    state.airSpeed = (Speed)EEPROM.read(MEM_ADDR_SPEED);
-    state.swing = EEPROM.read(MEM_ADDR_SWING);
-    state.airFlow = EEPROM.read(MEM_ADDR_AIRFLOW);
-    state.sleepMode = EEPROM.read(MEM_ADDR_SLEEP);
-    state.power = EEPROM.read(MEM_ADDR_POWER);
-    state.turbo = EEPROM.read(MEM_ADDR_TURBO);
-    state.hold = EEPROM.read(MEM_ADDR_HOLD);
-    state.timerSet = EEPROM.read(MEM_ADDR_TIMER_SET);
-    state.timerDelay = EEPROM.read(MEM_ADDR_TIMER_DELAY);
-    state.timerFrom = EEPROM.read(MEM_ADDR_TIMER_FROM);
+    state.bits = last.bits;
+    state.setTimerFrom(last.timerFrom);
   }
 };
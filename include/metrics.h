@@ -0,0 +1,148 @@
+// Publish the metrics (retained) on METRICS_TOPIC this often (ms)
+#ifndef METRICS_PUBLISH_MS
+#define METRICS_PUBLISH_MS 60000
+#endif
+
+// Sample the heap this often (ms), for the low-water mark
+#ifndef METRICS_SAMPLE_MS
+#define METRICS_SAMPLE_MS 1000
+#endif
+
+// Loop iterations taking longer than this count as stalls (us)
+#ifndef STALL_THRESHOLD_US
+#define STALL_THRESHOLD_US 50000
+#endif
+
+// Longest metrics payload
+#define MAX_METRICS_LENGTH 384
+
+/**
+ * Runtime resource metrics
+ *
+ * Loop period (time between two loop() starts): histogram and max per
+ * publish period, EWMA, stall count and longest stall since boot. Heap:
+ * free, largest free block and fragmentation at the last sample, lowest
+ * free heap since boot. Connection: MQTT session drops and time spent
+ * disconnected since boot, as the connection counts them. A device that
+ * degrades over weeks shows rising fragmentation, a sinking heap low-water
+ * mark or growing stalls first.
+ */
+class Metrics {
+
+  public: LatencyHistogram period;
+  public: uint32_t loops = 0;
+  public: uint32_t stalls = 0;
+  public: uint32_t longestStall = 0;
+  public: uint32_t freeHeap = 0;
+  public: uint32_t largestBlock = 0;
+  public: uint32_t heapLow = 0xFFFFFFFFUL;
+  public: uint8_t fragmentation = 0;
+  public: uint32_t changes[SOURCE_COUNT] = {};
+  public: uint32_t drops = 0;
+  public: unsigned long downtime = 0;  // ms
+
+  private: uint32_t averageScaled = 0;  // EWMA of the period (us * 16)
+  private: uint32_t lastLoopAt = 0;
+  private: unsigned long sampledAt = 0;
+  private: unsigned long periodStart = 0;
+
+  public: Metrics() {
+    memset(&period, 0, sizeof(period));
+  }
+
+  /**
+   * Call first thing in every loop()
+   */
+  public: void loop() {
+    uint32_t now = micros();
+    if (loops++ > 0) {
+      uint32_t elapsed = now - lastLoopAt;
+      period.add(elapsed);
+
+      // 1/64 weight per iteration
+      uint32_t clamped = elapsed < (1UL << 26) ? elapsed : (1UL << 26);
+      averageScaled += ((int32_t)(clamped * 16) - (int32_t)averageScaled) / 64;
+
+      if (elapsed >= STALL_THRESHOLD_US) {
+        stalls++;
+        if (elapsed > longestStall)
+          longestStall = elapsed;
+        if (DEBUG_MODE)
+          Serial.printf("[DEBUG] Loop stalled for %lu us\n", (unsigned long)elapsed);
+      }
+    }
+    lastLoopAt = now;
+
+    if (millis() - sampledAt >= METRICS_SAMPLE_MS)
+      sample();
+  }
+
+  /**
+   * Change bus listener
+   */
+  public: void onChange(const StateChange &change) {
+    changes[change.source]++;
+  }
+
+  public: uint32_t periodAverage() {
+    return averageScaled / 16;
+  }
+
+  public: void sample() {
+    sampledAt = millis();
+    freeHeap = ESP.getFreeHeap();
+    largestBlock = ESP.getMaxFreeBlockSize();
+    fragmentation = ESP.getHeapFragmentation();
+    if (freeHeap < heapLow)
+      heapLow = freeHeap;
+  }
+
+  public: void sampleConnection(uint32_t connectionDrops, unsigned long downtimeMs) {
+    drops = connectionDrops;
+    downtime = downtimeMs;
+  }
+
+  public: bool publishDue() {
+    return millis() - periodStart >= METRICS_PUBLISH_MS;
+  }
+
+  /**
+   * Start a new publish period (histogram and max)
+   */
+  public: void reset() {
+    memset(&period, 0, sizeof(period));
+    periodStart = millis();
+  }
+
+  /**
+   * Serialize (times in us, downtime in ms, heap in bytes)
+   */
+  public: const char *toJson(char *buffer, size_t size) {
+    int length = snprintf(buffer, size,
+      "{\"uptime\":%lu,\"loops\":%lu,\"loop_avg\":%lu,\"loop_max\":%lu,\"stalls\":%lu,\"stall_max\":%lu,"
+      "\"heap\":%lu,\"heap_min\":%lu,\"heap_block\":%lu,\"heap_frag\":%u,\"changes_ir\":%lu,\"changes_mqtt\":%lu,"
+      "\"drops\":%lu,\"downtime\":%lu,\"loop_buckets\":",
+      millis() / 1000, (unsigned long)loops, (unsigned long)periodAverage(), (unsigned long)period.max,
+      (unsigned long)stalls, (unsigned long)longestStall, (unsigned long)freeHeap,
+      (unsigned long)heapLow, (unsigned long)largestBlock, fragmentation,
+      (unsigned long)changes[SOURCE_IR], (unsigned long)changes[SOURCE_MQTT],
+      (unsigned long)drops, downtime);
+    length = period.appendBuckets(buffer, size, length);
+    if (length >= 0 && (size_t)length < size)
+      snprintf(buffer + length, size - length, "}");
+    return buffer;
+  }
+
+  public: void dump() {
+    Serial.printf("[DEBUG] Loop: %lu iterations, %lu us average, %lu us max, %lu stalls (longest %lu us)\n",
+      (unsigned long)loops, (unsigned long)periodAverage(), (unsigned long)period.max,
+      (unsigned long)stalls, (unsigned long)longestStall);
+    Serial.printf("[DEBUG] Heap: %lu bytes free (lowest %lu), largest block %lu, %u%% fragmented\n",
+      (unsigned long)freeHeap, (unsigned long)heapLow, (unsigned long)largestBlock, fragmentation);
+    Serial.printf("[DEBUG] Changes: %lu from IR, %lu from MQTT\n",
+      (unsigned long)changes[SOURCE_IR], (unsigned long)changes[SOURCE_MQTT]);
+    Serial.printf("[DEBUG] Connection: %lu drops, %lu ms disconnected\n", (unsigned long)drops, downtime);
+  }
+};
+
+Metrics metrics;
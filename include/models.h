@@ -1,82 +1,7 @@
-/**
- * Temperature
- * Second and fourth chars (0) get replaced with current Mode chars
- */
-char temperatures[17][5] = {
-  CHIGO_PARAM_TEMP_16,
-  CHIGO_PARAM_TEMP_17,
-  CHIGO_PARAM_TEMP_18,
-  CHIGO_PARAM_TEMP_19,
-  CHIGO_PARAM_TEMP_20,
-  CHIGO_PARAM_TEMP_21,
-  CHIGO_PARAM_TEMP_22,
-  CHIGO_PARAM_TEMP_23,
-  CHIGO_PARAM_TEMP_24,
-  CHIGO_PARAM_TEMP_25,
-  CHIGO_PARAM_TEMP_26,
-  CHIGO_PARAM_TEMP_27,
-  CHIGO_PARAM_TEMP_28,
-  CHIGO_PARAM_TEMP_29,
-  CHIGO_PARAM_TEMP_30,
-  CHIGO_PARAM_TEMP_31,
-  CHIGO_PARAM_TEMP_32
-};
-
-char newTimerDelays[25][5] = {
-  CHIGO_TIMER_NEW_0h,
-  CHIGO_TIMER_NEW_1h,
-  CHIGO_TIMER_NEW_2h,
-  CHIGO_TIMER_NEW_3h,
-  CHIGO_TIMER_NEW_4h,
-  CHIGO_TIMER_NEW_5h,
-  CHIGO_TIMER_NEW_6h,
-  CHIGO_TIMER_NEW_7h,
-  CHIGO_TIMER_NEW_8h,
-  CHIGO_TIMER_NEW_9h,
-  CHIGO_TIMER_NEW_10h,
-  CHIGO_TIMER_NEW_11h,
-  CHIGO_TIMER_NEW_12h,
-  CHIGO_TIMER_NEW_13h,
-  CHIGO_TIMER_NEW_14h,
-  CHIGO_TIMER_NEW_15h,
-  CHIGO_TIMER_NEW_16h,
-  CHIGO_TIMER_NEW_17h,
-  CHIGO_TIMER_NEW_18h,
-  CHIGO_TIMER_NEW_19h,
-  CHIGO_TIMER_NEW_20h,
-  CHIGO_TIMER_NEW_21h,
-  CHIGO_TIMER_NEW_22h,
-  CHIGO_TIMER_NEW_23h,
-  CHIGO_TIMER_NEW_24h,
-};
-
-char oldTimerDelays[25][5] = {
-  CHIGO_TIMER_OLD_0h,
-  CHIGO_TIMER_OLD_1h,
-  CHIGO_TIMER_OLD_2h,
-  CHIGO_TIMER_OLD_3h,
-  CHIGO_TIMER_OLD_4h,
-  CHIGO_TIMER_OLD_5h,
-  CHIGO_TIMER_OLD_6h,
-  CHIGO_TIMER_OLD_7h,
-  CHIGO_TIMER_OLD_8h,
-  CHIGO_TIMER_OLD_9h,
-  CHIGO_TIMER_OLD_10h,
-  CHIGO_TIMER_OLD_11h,
-  CHIGO_TIMER_OLD_12h,
-  CHIGO_TIMER_OLD_13h,
-  CHIGO_TIMER_OLD_14h,
-  CHIGO_TIMER_OLD_15h,
-  CHIGO_TIMER_OLD_16h,
-  CHIGO_TIMER_OLD_17h,
-  CHIGO_TIMER_OLD_18h,
-  CHIGO_TIMER_OLD_19h,
-  CHIGO_TIMER_OLD_20h,
-  CHIGO_TIMER_OLD_21h,
-  CHIGO_TIMER_OLD_22h,
-  CHIGO_TIMER_OLD_23h,
-  CHIGO_TIMER_OLD_24h,
-};
+// AC units driven by this node (one IR emitter each)
+#ifndef HVAC_UNITS
+#define HVAC_UNITS 1
+#endif
 
 enum Mode {
   Auto = 0, Cool, Dry, Heat, Fan
@@ -86,20 +11,110 @@ enum Speed {
   Slow = 0, Medium, Fast, Smart
 };
 
+/**
+ * Packed state layout: bit offset and width of every field in HvacState::bits
+ */
+#define STATE_TEMPERATURE_SHIFT 0
+#define STATE_TEMPERATURE_BITS  6
+#define STATE_MODE_SHIFT        6
+#define STATE_MODE_BITS         3
+#define STATE_SPEED_SHIFT       9
+#define STATE_SPEED_BITS        2
+#define STATE_AIRFLOW_SHIFT     11
+#define STATE_SLEEP_SHIFT       12
+#define STATE_SWING_SHIFT       13
+#define STATE_SWING_BITS        2
+#define STATE_POWER_SHIFT       15
+#define STATE_TURBO_SHIFT       16
+#define STATE_HOLD_SHIFT        17
+#define STATE_TIMER_SET_SHIFT   18
+#define STATE_TIMER_DELAY_SHIFT 19
+#define STATE_TIMER_DELAY_BITS  5
+#define STATE_TIMER_FROM_SHIFT  31 // change mask only: timer word differs
+
+#define STATE_MASK(shift, bits) (((1UL << (bits)) - 1) << (shift))
+
+typedef uint32_t ChangeMask;
+
+/**
+ * State fields, used as masks of a change mask
+ * A change mask is the XOR of two packed states, so every field covers
+ * the bits it occupies.
+ */
+enum StateField : ChangeMask {
+  FIELD_TEMPERATURE = STATE_MASK(STATE_TEMPERATURE_SHIFT, STATE_TEMPERATURE_BITS),
+  FIELD_MODE        = STATE_MASK(STATE_MODE_SHIFT, STATE_MODE_BITS),
+  FIELD_SPEED       = STATE_MASK(STATE_SPEED_SHIFT, STATE_SPEED_BITS),
+  FIELD_AIRFLOW     = 1UL << STATE_AIRFLOW_SHIFT,
+  FIELD_SLEEP       = 1UL << STATE_SLEEP_SHIFT,
+  FIELD_SWING       = STATE_MASK(STATE_SWING_SHIFT, STATE_SWING_BITS),
+  FIELD_POWER       = 1UL << STATE_POWER_SHIFT,
+  FIELD_TURBO       = 1UL << STATE_TURBO_SHIFT,
+  FIELD_HOLD        = 1UL << STATE_HOLD_SHIFT,
+  FIELD_TIMER       = (1UL << STATE_TIMER_SET_SHIFT) |
+                      STATE_MASK(STATE_TIMER_DELAY_SHIFT, STATE_TIMER_DELAY_BITS) |
+                      (1UL << STATE_TIMER_FROM_SHIFT),
+  FIELD_ALL         = 0xFFFFFFFFUL
+};
+
 /**
  * State of device
+ * Packed into one word plus the timer start, so it is cheap to copy,
+ * compare and store (8 bytes).
  */
 class HvacState {
-  public: unsigned temperature = 25;
-  public: Mode mode = Auto;
-  public: Speed airSpeed = Smart;
-  public: bool airFlow = false;
-  public: bool sleepMode = false;
-  public: unsigned swing = 0;
-  public: bool power = false;
-  public: bool turbo = false;
-  public: bool hold = false;
-  public: bool timerSet = false;
-  public: unsigned timerDelay = 0;
-  public: unsigned long timerFrom = 0;
-};
\ No newline at end of file
+  public: uint32_t bits = defaultBits();
+  public: uint32_t timer = 0;
+
+  private: static constexpr uint32_t defaultBits() {
+    return (25UL << STATE_TEMPERATURE_SHIFT) | ((uint32_t)Auto << STATE_MODE_SHIFT) | ((uint32_t)Smart << STATE_SPEED_SHIFT);
+  }
+
+  private: constexpr uint32_t get(uint8_t shift, uint8_t width) const {
+    return (bits >> shift) & ((1UL << width) - 1);
+  }
+
+  private: void set(uint8_t shift, uint8_t width, uint32_t value) {
+    uint32_t mask = STATE_MASK(shift, width);
+    bits = (bits & ~mask) | ((value << shift) & mask);
+  }
+
+  public: constexpr unsigned temperature() const { return get(STATE_TEMPERATURE_SHIFT, STATE_TEMPERATURE_BITS); }
+  public: constexpr Mode mode() const { return (Mode)get(STATE_MODE_SHIFT, STATE_MODE_BITS); }
+  public: constexpr Speed airSpeed() const { return (Speed)get(STATE_SPEED_SHIFT, STATE_SPEED_BITS); }
+  public: constexpr bool airFlow() const { return get(STATE_AIRFLOW_SHIFT, 1); }
+  public: constexpr bool sleepMode() const { return get(STATE_SLEEP_SHIFT, 1); }
+  public: constexpr unsigned swing() const { return get(STATE_SWING_SHIFT, STATE_SWING_BITS); }
+  public: constexpr bool power() const { return get(STATE_POWER_SHIFT, 1); }
+  public: constexpr bool turbo() const { return get(STATE_TURBO_SHIFT, 1); }
+  public: constexpr bool hold() const { return get(STATE_HOLD_SHIFT, 1); }
+  public: constexpr bool timerSet() const { return get(STATE_TIMER_SET_SHIFT, 1); }
+  public: constexpr unsigned timerDelay() const { return get(STATE_TIMER_DELAY_SHIFT, STATE_TIMER_DELAY_BITS); }
+  public: constexpr unsigned long timerFrom() const { return timer; }
+
+  public: void setTemperature(unsigned value) { set(STATE_TEMPERATURE_SHIFT, STATE_TEMPERATURE_BITS, value); }
+  public: void setMode(Mode value) { set(STATE_MODE_SHIFT, STATE_MODE_BITS, value); }
+  public: void setAirSpeed(Speed value) { set(STATE_SPEED_SHIFT, STATE_SPEED_BITS, value); }
+  public: void setAirFlow(bool value) { set(STATE_AIRFLOW_SHIFT, 1, value); }
+  public: void setSleepMode(bool value) { set(STATE_SLEEP_SHIFT, 1, value); }
+  public: void setSwing(unsigned value) { set(STATE_SWING_SHIFT, STATE_SWING_BITS, value); }
+  public: void setPower(bool value) { set(STATE_POWER_SHIFT, 1, value); }
+  public: void setTurbo(bool value) { set(STATE_TURBO_SHIFT, 1, value); }
+  public: void setHold(bool value) { set(STATE_HOLD_SHIFT, 1, value); }
+  public: void setTimerSet(bool value) { set(STATE_TIMER_SET_SHIFT, 1, value); }
+  public: void setTimerDelay(unsigned value) { set(STATE_TIMER_DELAY_SHIFT, STATE_TIMER_DELAY_BITS, value); }
+  public: void setTimerFrom(unsigned long value) { timer = value; }
+
+  /**
+   * Mask of fields that differ between two states
+   */
+  public: static constexpr ChangeMask diff(const HvacState &a, const HvacState &b) {
+    return (a.bits ^ b.bits) | (a.timer != b.timer ? 1UL << STATE_TIMER_FROM_SHIFT : 0);
+  }
+};
+
+static_assert(STATE_TIMER_DELAY_SHIFT + STATE_TIMER_DELAY_BITS <= STATE_TIMER_FROM_SHIFT, "HvacState fields overlap");
+
+inline ChangeMask diffState(const HvacState &a, const HvacState &b) {
+  return HvacState::diff(a, b);
+}
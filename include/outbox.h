@@ -0,0 +1,171 @@
+// Outbound topics that can wait at the same time (one slot per topic)
+#ifndef OUTBOX_SLOTS
+#define OUTBOX_SLOTS (7 * HVAC_UNITS + 1)
+#endif
+
+// Longest queued payload (the JSON state)
+#ifndef OUTBOX_PAYLOAD_LENGTH
+#define OUTBOX_PAYLOAD_LENGTH 192
+#endif
+
+// Drain rate (messages/s) and how many messages may go out back to back
+#ifndef OUTBOX_RATE
+#define OUTBOX_RATE 50
+#endif
+
+#ifndef OUTBOX_BURST
+#define OUTBOX_BURST 8
+#endif
+
+#define OUTBOX_COST_US (1000000UL / OUTBOX_RATE)
+#define OUTBOX_NO_UNIT 0xFF
+
+typedef void (*SentCallback)(uint8_t unit);
+
+/**
+ * Outbound publish queue with last-value coalescing
+ *
+ * Every topic takes one of a fixed number of slots. A newer payload for a
+ * topic that is still waiting replaces the queued one and keeps its place
+ * in line, so a burst of changes costs a copy each and only the latest
+ * value goes on the wire. loop() drains the oldest slots at OUTBOX_RATE
+ * with bursts of up to OUTBOX_BURST, while connected. A message refused
+ * because the session went down stays queued for the next one, a message
+ * refused on a live session (too long for the client) is dropped.
+ */
+class Outbox {
+
+  private: struct Slot {
+    uint32_t hash;
+    uint32_t sequence;  // place in line, 0: free
+    uint8_t unit;       // for the sent callback
+    bool retained;
+    uint16_t length;
+    char topic[MAX_TOPIC_LENGTH];
+    uint8_t payload[OUTBOX_PAYLOAD_LENGTH];
+  };
+
+  private: PubSubClient &client;
+  private: SentCallback callback = NULL;
+  private: Slot slots[OUTBOX_SLOTS];
+  private: uint32_t nextSequence = 1;
+  private: uint32_t credit = OUTBOX_BURST * OUTBOX_COST_US;  // us of drain time
+  private: uint32_t refilledAt = 0;
+
+  public: uint8_t depth = 0;
+  public: uint8_t peak = 0;           // highest depth
+  public: uint32_t queued = 0;
+  public: uint32_t coalesced = 0;    // replaced a waiting payload
+  public: uint32_t dropped = 0;      // no free slot
+  public: uint32_t oversized = 0;    // topic or payload too long
+  public: uint32_t sent = 0;
+  public: uint32_t failed = 0;       // publish refused
+
+  public: Outbox(PubSubClient &client) : client(client) {
+    memset(slots, 0, sizeof(slots));
+  }
+
+  public: void begin(SentCallback onSent = NULL) {
+    callback = onSent;
+    refilledAt = micros();
+  }
+
+  /**
+   * Queue a message, replacing a waiting one on the same topic
+   */
+  public: bool publish(const char *topic, const char *payload, bool retained = false, uint8_t unit = OUTBOX_NO_UNIT) {
+    return publish(topic, (const uint8_t *)payload, strlen(payload), retained, unit);
+  }
+
+  public: bool publish(const char *topic, const uint8_t *payload, unsigned length, bool retained = false, uint8_t unit = OUTBOX_NO_UNIT) {
+    size_t topicLength = strlen(topic);
+    if (topicLength >= MAX_TOPIC_LENGTH || length > OUTBOX_PAYLOAD_LENGTH) {
+      oversized++;
+      return false;
+    }
+
+    uint32_t h = Router::hash(topic, topicLength);
+    Slot *free = NULL;
+    for (uint8_t i = 0; i < OUTBOX_SLOTS; i++) {
+      Slot &slot = slots[i];
+      if (slot.sequence == 0) {
+        if (!free)
+          free = &slot;
+      }
+      else if (slot.hash == h && strcmp(slot.topic, topic) == 0) {
+        memcpy(slot.payload, payload, length);
+        slot.length = length;
+        slot.retained = retained;
+        slot.unit = unit;
+        coalesced++;
+        return true;
+      }
+    }
+
+    if (!free) {
+      dropped++;
+      return false;
+    }
+    free->hash = h;
+    free->sequence = nextSequence++;
+    free->unit = unit;
+    free->retained = retained;
+    memcpy(free->topic, topic, topicLength + 1);
+    memcpy(free->payload, payload, length);
+    free->length = length;
+    queued++;
+    if (++depth > peak)
+      peak = depth;
+    return true;
+  }
+
+  /**
+   * Send waiting messages, oldest first, as the drain rate allows
+   */
+  public: void loop() {
+    uint32_t now = micros();
+    uint32_t elapsed = now - refilledAt;
+    refilledAt = now;
+    uint32_t limit = OUTBOX_BURST * OUTBOX_COST_US;
+    credit = elapsed >= limit - credit ? limit : credit + elapsed;
+
+    while (depth > 0 && credit >= OUTBOX_COST_US && client.connected()) {
+      Slot *oldest = NULL;
+      for (uint8_t i = 0; i < OUTBOX_SLOTS; i++)
+        if (slots[i].sequence && (!oldest || slots[i].sequence < oldest->sequence))
+          oldest = &slots[i];
+
+      uint32_t started = micros();
+      bool published = client.publish(oldest->topic, oldest->payload, oldest->length, oldest->retained);
+      if (!published) {
+        failed++;
+        if (!client.connected())
+          return;
+      }
+      else {
+        tracer.record(TRACE_PUBLISH, micros() - started);
+        sent++;
+      }
+      credit -= OUTBOX_COST_US;
+      oldest->sequence = 0;
+      depth--;
+      if (published && callback && oldest->unit != OUTBOX_NO_UNIT)
+        callback(oldest->unit);
+    }
+  }
+
+  public: bool isEmpty() {
+    return depth == 0;
+  }
+
+  /**
+   * Serialize the counters
+   */
+  public: const char *toJson(char *buffer, size_t size) {
+    snprintf(buffer, size,
+      "{\"depth\":%u,\"peak\":%u,\"queued\":%lu,\"coalesced\":%lu,\"dropped\":%lu,\"oversized\":%lu,\"sent\":%lu,\"failed\":%lu}",
+      depth, peak, (unsigned long)queued, (unsigned long)coalesced, (unsigned long)dropped,
+      (unsigned long)oversized, (unsigned long)sent, (unsigned long)failed);
+    return buffer;
+  }
+};
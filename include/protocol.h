@@ -0,0 +1,37 @@
+// IR protocol of the units, a traits class (see zhjt03.h)
+// The receiver, transmitter and frame topics are shared, so a build speaks
+// one protocol.
+#ifndef HVAC_PROTOCOL
+#define HVAC_PROTOCOL ZhJt03
+#endif
+
+typedef HVAC_PROTOCOL HvacProtocol;
+typedef HvacProtocol::Frame Frame;
+
+#define FRAME_WORDS HvacProtocol::WORDS
+#define FRAME_BITS  (FRAME_WORDS * 16)
+#define FRAME_BYTES (FRAME_WORDS * 2)
+#define RAW_FRAME_LENGTH HvacProtocol::RAW_LENGTH
+
+/**
+ * Raw frame bytes (.../frame topics): the words in order, MSB first
+ */
+inline void frameToBytes(const Frame &frame, uint8_t *bytes) {
+  uint16_t words[FRAME_WORDS];
+  HvacProtocol::toWords(frame, words);
+  for (uint8_t i = 0; i < FRAME_WORDS; i++) {
+    bytes[2 * i] = words[i] >> 8;
+    bytes[2 * i + 1] = words[i] & 0xFF;
+  }
+}
+
+inline Frame frameFromBytes(const uint8_t *bytes) {
+  uint16_t words[FRAME_WORDS];
+  for (uint8_t i = 0; i < FRAME_WORDS; i++)
+    words[i] = (bytes[2 * i] << 8) | bytes[2 * i + 1];
+  return HvacProtocol::fromWords(words);
+}
+
+inline bool isFrameIntact(const Frame &frame) {
+  return HvacProtocol::isIntact(frame);
+}
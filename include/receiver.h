@@ -0,0 +1,161 @@
+#include <IRrecv.h>
+
+// Header and footer timings are at least this long, bit timings shorter (us)
+#ifndef RECEIVER_LONG_US
+#define RECEIVER_LONG_US 3000
+#endif
+
+// A frame without an edge for this long was cut off (us)
+#ifndef RECEIVER_STALE_US
+#define RECEIVER_STALE_US 20000
+#endif
+
+/**
+ * Bit i set if edge i of a framing pattern is long ("110": long header
+ * mark, long header space, short bit mark)
+ */
+constexpr uint32_t longEdges(const char *pattern, uint8_t i = 0) {
+  return pattern[i] ? ((pattern[i] == '1' ? 1UL << i : 0) | longEdges(pattern, i + 1)) : 0;
+}
+
+/**
+ * Streaming IR receiver
+ *
+ * Fed from the edge interrupt: every edge closes one mark or space, which
+ * advances a header -> body -> footer state machine over a buffer of exactly
+ * one frame. The frame is reported as soon as the footer's end mark is
+ * closed, there is no trailing timeout. Anything that does not fit the
+ * protocol layout (long bit, short header, missed edge) restarts the search
+ * for a header. Which header and footer edges are long comes from the
+ * protocol's HEADER_PATTERN and FOOTER_PATTERN.
+ *
+ * The buffer keeps the decode_results layout (leading gap, RAWTICK units),
+ * so it can be handed to the decoder as is.
+ */
+class Receiver {
+
+  private: static constexpr uint16_t HEADER_EDGES = sizeof(HvacProtocol::HEADER_PATTERN) - 1;
+  private: static constexpr uint16_t FOOTER_START = RAW_FRAME_LENGTH - (sizeof(HvacProtocol::FOOTER_PATTERN) - 1);
+  private: static constexpr uint32_t HEADER_LONG = longEdges(HvacProtocol::HEADER_PATTERN);
+  private: static constexpr uint32_t FOOTER_LONG = longEdges(HvacProtocol::FOOTER_PATTERN);
+
+  private: uint8_t pin;
+  private: uint16_t buffer[RAW_FRAME_LENGTH + 1];
+  private: volatile uint16_t position = 0;  // durations of the current frame
+  private: volatile bool ready = false;
+  private: uint16_t gap = 0xFFFF;
+  private: volatile uint32_t lastEdge = 0;
+
+  public: volatile uint32_t frames = 0;
+  public: volatile uint32_t aborted = 0;
+  public: volatile uint32_t overruns = 0;
+
+  private: static Receiver *instance;
+
+  public: Receiver(uint8_t pin) : pin(pin) {}
+
+  public: void begin() {
+    instance = this;
+    pinMode(pin, INPUT);
+    lastEdge = micros();
+#ifdef ARDUINO_ARCH_ESP8266
+    attachInterrupt(digitalPinToInterrupt(pin), onEdge, CHANGE);
+#endif
+  }
+
+  /**
+   * Hand out a complete frame; the buffer stays locked until resume()
+   */
+  public: bool decode(decode_results *results) {
+    if (!ready)
+      return false;
+    results->rawbuf = buffer;
+    results->rawlen = RAW_FRAME_LENGTH + 1;
+    results->overflow = false;
+    return true;
+  }
+
+  public: void resume() {
+    ready = false;
+  }
+
+  /**
+   * No frame in progress or waiting to be decoded
+   * A frame that stopped mid-way is dropped here, the ISR only sees edges.
+   */
+  public: bool isIdle() {
+    if (position != 0 && micros() - lastEdge >= RECEIVER_STALE_US) {
+      position = 0;
+      aborted++;
+    }
+    return position == 0 && !ready;
+  }
+
+#ifdef ARDUINO_ARCH_ESP8266
+  // The output is low while the carrier is on: a rising edge ends a mark
+  private: static void IRAM_ATTR onEdge() {
+    uint32_t now = micros();
+    Receiver *self = instance;
+    self->feed(now - self->lastEdge, digitalRead(self->pin) == HIGH);
+    self->lastEdge = now;
+  }
+#endif
+
+  /**
+   * Advance by one mark or space of the given duration (us)
+   * Marks are on even positions, spaces on odd ones.
+   */
+  public: void IRAM_ATTR feed(uint32_t duration, bool mark) {
+    bool isLong = duration >= RECEIVER_LONG_US;
+    uint16_t at = position;
+
+    if (ready) {
+      if (mark && isLong)
+        overruns++;
+      return;
+    }
+
+    if (at > 0) {
+      bool expected;
+      if (mark != ((at & 1) == 0))
+        expected = false;                     // missed an edge
+      else if (at < HEADER_EDGES)
+        expected = isLong == ((HEADER_LONG >> at) & 1);
+      else if (at >= FOOTER_START)
+        expected = isLong == ((FOOTER_LONG >> (at - FOOTER_START)) & 1);
+      else
+        expected = !isLong;                   // bits
+
+      if (expected) {
+        buffer[at + 1] = toTicks(duration);
+        if (++at == RAW_FRAME_LENGTH) {
+          at = 0;
+          frames++;
+          ready = true;
+        }
+        position = at;
+        return;
+      }
+
+      aborted++;
+      position = 0;
+    }
+
+    // Looking for a header mark, spaces before it are the gap
+    if (!mark) {
+      gap = toTicks(duration);
+    }
+    else if (isLong) {
+      buffer[0] = gap;
+      buffer[1] = toTicks(duration);
+      position = 1;
+    }
+  }
+
+  private: static uint16_t IRAM_ATTR toTicks(uint32_t duration) {
+    duration /= RAWTICK;
+    return duration > 0xFFFF ? 0xFFFF : duration;
+  }
+};
+
+Receiver *Receiver::instance = NULL;
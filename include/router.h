@@ -0,0 +1,228 @@
+// Maximum number of MQTT routes
+#ifndef MAX_ROUTES
+#define MAX_ROUTES 16
+#endif
+
+// Longest topic (unit prefix and route suffix)
+#ifndef MAX_TOPIC_LENGTH
+#define MAX_TOPIC_LENGTH 64
+#endif
+
+enum PayloadType {
+  PAYLOAD_BOOL,  // "1"/"0", "on"/"off", "true"/"false"
+  PAYLOAD_INT,   // decimal, fraction is truncated
+  PAYLOAD_ENUM,  // index into Route::values
+  PAYLOAD_FRAME, // FRAME_BYTES raw frame bytes, for Route::frameHandler
+  PAYLOAD_JSON   // flat JSON object, for Route::jsonHandler
+};
+
+typedef void (*RouteHandler)(uint8_t unit, int value);
+typedef void (*FrameHandler)(uint8_t unit, const Frame &frame);
+typedef bool (*JsonHandler)(uint8_t unit, const JsonObject &json);
+
+struct Route {
+  const char *suffix;         // subscribe topic after the unit prefix
+  PayloadType type;
+  const char *const *values;  // accepted values (PAYLOAD_ENUM)
+  uint8_t count;
+  RouteHandler handler;
+  FrameHandler frameHandler;  // PAYLOAD_FRAME
+  JsonHandler jsonHandler;    // PAYLOAD_JSON, false rejects the message
+};
+
+/**
+ * MQTT topic router
+ *
+ * Built from a route table of topic suffixes, shared by all units. A topic
+ * is matched by its unit prefix, then by hashing the rest once and
+ * comparing it with the precomputed route hashes. Payloads are parsed in
+ * place from the (payload, length) span without copying. Enum values are
+ * indexed by length, so a value of a length no entry has is rejected
+ * without a compare.
+ */
+class Router {
+
+  private: const Route *routes;
+  private: uint8_t count;
+  private: const char *const *prefixes = NULL;
+  private: uint8_t units = 0;
+  private: uint32_t hashes[MAX_ROUTES];
+  private: uint32_t valueLengths[MAX_ROUTES];  // bit n: an enum value has length n
+  private: char buffer[MAX_TOPIC_LENGTH];
+
+  public: uint32_t dispatched = 0;
+  public: uint32_t rejected = 0;
+
+  public: template <size_t N> Router(const Route (&table)[N]) : routes(table), count(N) {
+    static_assert(N <= MAX_ROUTES, "Too many routes, raise MAX_ROUTES");
+  }
+
+  public: static uint32_t hash(const char *str, size_t length) {
+    uint32_t h = 2166136261UL; // FNV-1a
+    for (size_t i = 0; i < length; i++)
+      h = (h ^ (uint8_t)str[i]) * 16777619UL;
+    return h;
+  }
+
+  /**
+   * Set the unit topic prefixes and precompute the route hashes
+   */
+  public: void begin(const char *const *unitPrefixes, uint8_t unitCount) {
+    prefixes = unitPrefixes;
+    units = unitCount;
+    for (uint8_t i = 0; i < count; i++) {
+      hashes[i] = hash(routes[i].suffix, strlen(routes[i].suffix));
+      valueLengths[i] = 0;
+      for (uint8_t j = 0; j < routes[i].count; j++)
+        if (strlen(routes[i].values[j]) < 32)
+          valueLengths[i] |= 1UL << strlen(routes[i].values[j]);
+    }
+  }
+
+  public: uint8_t size() {
+    return count;
+  }
+
+  /**
+   * Full topic of a unit (valid until the next call)
+   */
+  public: const char* topic(uint8_t unit, const char *suffix) {
+    snprintf(buffer, sizeof(buffer), "%s%s", prefixes[unit], suffix);
+    return buffer;
+  }
+
+  public: const char* topic(uint8_t unit, uint8_t i) {
+    return topic(unit, routes[i].suffix);
+  }
+
+  /**
+   * Parsers (return false for unknown values)
+   */
+
+  private: static bool parseInt(const byte *payload, unsigned length, int &value) {
+    unsigned i = 0;
+    bool negative = false;
+    if (i < length && (payload[i] == '-' || payload[i] == '+'))
+      negative = payload[i++] == '-';
+
+    unsigned digits = 0;
+    value = 0;
+    for (; i < length && payload[i] >= '0' && payload[i] <= '9' && digits < 6; i++, digits++)
+      value = value * 10 + (payload[i] - '0');
+    if (negative)
+      value = -value;
+
+    // Allow a fraction (e.g. "24.5"), it is truncated
+    if (i < length && payload[i] == '.')
+      for (i++; i < length && payload[i] >= '0' && payload[i] <= '9'; i++);
+
+    return digits > 0 && i == length;
+  }
+
+  private: static bool matches(const byte *payload, unsigned length, const char *value) {
+    return strlen(value) == length && strncasecmp((const char*)payload, value, length) == 0;
+  }
+
+  private: static bool parseBool(const byte *payload, unsigned length, int &value) {
+    if (matches(payload, length, "on") || matches(payload, length, "true")) {
+      value = 1;
+      return true;
+    }
+    if (matches(payload, length, "off") || matches(payload, length, "false")) {
+      value = 0;
+      return true;
+    }
+    if (!parseInt(payload, length, value))
+      return false;
+    value = value > 0;
+    return true;
+  }
+
+  private: bool parseEnum(uint8_t index, const byte *payload, unsigned length, int &value) {
+    if (length >= 32 || !(valueLengths[index] & (1UL << length)))
+      return false;
+
+    // Only values of the same length are compared
+    const Route &route = routes[index];
+    for (uint8_t i = 0; i < route.count; i++)
+      if (strlen(route.values[i]) == length && memcmp(payload, route.values[i], length) == 0) {
+        value = i;
+        return true;
+      }
+    return false;
+  }
+
+  private: static bool parseFrame(const byte *payload, unsigned length, Frame &frame) {
+    if (length != FRAME_BYTES)
+      return false;
+    frame = frameFromBytes(payload);
+    return isFrameIntact(frame);
+  }
+
+  /**
+   * Route a message to its handler, returns false if it was rejected
+   */
+  public: bool dispatch(const char *topic, const byte *payload, unsigned length) {
+    // Prefixes may be prefixes of each other ("ac1", "ac10"), so try all
+    for (uint8_t unit = 0; unit < units; unit++) {
+      size_t prefixLength = strlen(prefixes[unit]);
+      if (strncmp(topic, prefixes[unit], prefixLength) == 0 &&
+        dispatch(unit, topic + prefixLength, payload, length))
+        return true;
+    }
+
+    rejected++;
+    return false;
+  }
+
+  private: bool dispatch(uint8_t unit, const char *suffix, const byte *payload, unsigned length) {
+    uint32_t started = micros();
+    uint32_t h = hash(suffix, strlen(suffix));
+    for (uint8_t i = 0; i < count; i++) {
+      if (hashes[i] != h || strcmp(suffix, routes[i].suffix) != 0)
+        continue;
+
+      const Route &route = routes[i];
+      int value = 0;
+      Frame frame;
+      JsonObject json;
+      bool valid;
+      switch (route.type) {
+        case PAYLOAD_BOOL:
+          valid = parseBool(payload, length, value);
+          break;
+        case PAYLOAD_INT:
+          valid = parseInt(payload, length, value);
+          break;
+        case PAYLOAD_FRAME:
+          valid = parseFrame(payload, length, frame);
+          break;
+        case PAYLOAD_JSON:
+          valid = json.parse(payload, length);
+          break;
+        default:
+          valid = parseEnum(i, payload, length, value);
+      }
+
+      if (!valid)
+        return false;
+
+      uint32_t parsed = micros();
+      tracer.record(TRACE_PARSE, parsed - started);
+      if (route.type == PAYLOAD_JSON) {
+        if (!route.jsonHandler(unit, json))
+          return false;
+      }
+      else if (route.type == PAYLOAD_FRAME)
+        route.frameHandler(unit, frame);
+      else
+        route.handler(unit, value);
+      tracer.startRequest(unit, started);
+      tracer.record(TRACE_SETTER, micros() - parsed);
+      dispatched++;
+      return true;
+    }
+
+    return false;
+  }
+};
\ No newline at end of file
@@ -0,0 +1,146 @@
+// Record stage latencies and publish them on DIAGNOSTICS_TOPIC
+#ifndef TRACE_MODE
+#define TRACE_MODE true
+#endif
+
+// Publish (and restart) the histograms this often (ms)
+#ifndef TRACE_PUBLISH_MS
+#define TRACE_PUBLISH_MS 60000
+#endif
+
+// Longest diagnostics payload (all buckets used)
+#define MAX_DIAGNOSTICS_LENGTH 224
+
+// Bucket 0 counts latencies below 32 us, every further bucket doubles the
+// bound, the last one takes everything above 2^(TRACE_BUCKETS + 3) us
+#define TRACE_BUCKETS 16
+#define TRACE_FIRST_BUCKET_BITS 5
+
+enum TraceStage : uint8_t {
+  TRACE_PARSE,      // topic match and payload parsing
+  TRACE_SETTER,     // route handler (controller setter)
+  TRACE_COALESCE,   // first command until its frame is queued
+  TRACE_BUILD,      // frame building
+  TRACE_TX_WAIT,    // frame queued until it goes on air
+  TRACE_ENCODE,     // raw timings of the frame (frame cache)
+  TRACE_AIRTIME,    // first to last edge
+  TRACE_SAVE,       // journal write
+  TRACE_PUBLISH,    // client.publish() from the outbox
+  TRACE_SET_TO_GET, // set message until the state is published
+  TRACE_STAGES
+};
+
+const char *const traceStageNames[TRACE_STAGES] = {
+  "parse", "setter", "coalesce", "build", "tx_wait", "encode", "airtime", "save", "publish", "set_to_get"
+};
+
+/**
+ * Fixed-bucket latency histogram (log2 buckets of microseconds)
+ */
+struct LatencyHistogram {
+  uint32_t buckets[TRACE_BUCKETS];
+  uint32_t count;
+  uint32_t max;
+  uint32_t total;   // us, saturating
+
+  void add(uint32_t us) {
+    uint8_t bucket = 0;
+    if (us >> TRACE_FIRST_BUCKET_BITS) {
+      bucket = 32 - __builtin_clz(us) - TRACE_FIRST_BUCKET_BITS;
+      if (bucket >= TRACE_BUCKETS)
+        bucket = TRACE_BUCKETS - 1;
+    }
+    buckets[bucket]++;
+    count++;
+    if (us > max)
+      max = us;
+    total = total + us < total ? 0xFFFFFFFFUL : total + us;
+  }
+
+  /**
+   * Append the buckets as a JSON array, trailing empty buckets are left out
+   */
+  int appendBuckets(char *buffer, size_t size, int length) const {
+    uint8_t used = TRACE_BUCKETS;
+    while (used > 0 && buckets[used - 1] == 0)
+      used--;
+    if (length >= 0 && (size_t)length < size)
+      length += snprintf(buffer + length, size - length, "[");
+    for (uint8_t i = 0; i < used && length >= 0 && (size_t)length < size; i++)
+      length += snprintf(buffer + length, size - length, i ? ",%lu" : "%lu", (unsigned long)buckets[i]);
+    if (length >= 0 && (size_t)length < size)
+      length += snprintf(buffer + length, size - length, "]");
+    return length;
+  }
+
+  /**
+   * Serialize: {"n":..,"avg":..,"max":..,"buckets":[..]} (us)
+   */
+  const char *toJson(char *buffer, size_t size) const {
+    int length = snprintf(buffer, size, "{\"n\":%lu,\"avg\":%lu,\"max\":%lu,\"buckets\":",
+      (unsigned long)count, count ? (unsigned long)(total / count) : 0UL, (unsigned long)max);
+    length = appendBuckets(buffer, size, length);
+    if (length >= 0 && (size_t)length < size)
+      snprintf(buffer + length, size - length, "}");
+    return buffer;
+  }
+};
+
+/**
+ * Stage latency tracer
+ *
+ * Trace points take micros() (steady clock on the host) before and after a
+ * stage and record the difference. Recording is a bucket increment, so it
+ * can stay on in production; the histograms are published and restarted
+ * every TRACE_PUBLISH_MS.
+ */
+class Tracer {
+
+  private: LatencyHistogram stages[TRACE_STAGES];
+  private: uint32_t requestAt[HVAC_UNITS];
+  private: bool requestPending[HVAC_UNITS];
+  private: unsigned long periodStart = 0;
+
+  public: Tracer() {
+    memset(requestPending, 0, sizeof(requestPending));
+    reset();
+  }
+
+  public: void record(TraceStage stage, uint32_t us) {
+    if (TRACE_MODE)
+      stages[stage].add(us);
+  }
+
+  /**
+   * A set message for a unit arrived (at, micros()); finished by its next
+   * state publish
+   */
+  public: void startRequest(uint8_t unit, uint32_t at) {
+    if (requestPending[unit])
+      return;
+    requestAt[unit] = at;
+    requestPending[unit] = true;
+  }
+
+  public: void finishRequest(uint8_t unit) {
+    if (!requestPending[unit])
+      return;
+    record(TRACE_SET_TO_GET, micros() - requestAt[unit]);
+    requestPending[unit] = false;
+  }
+
+  public: const LatencyHistogram &histogram(TraceStage stage) {
+    return stages[stage];
+  }
+
+  public: bool publishDue() {
+    return TRACE_MODE && millis() - periodStart >= TRACE_PUBLISH_MS;
+  }
+
+  public: void reset() {
+    memset(stages, 0, sizeof(stages));
+    periodStart = millis();
+  }
+};
+
+Tracer tracer;
@@ -0,0 +1,345 @@
+#ifndef ARDUINO_ARCH_ESP8266
+#include <IRsend.h>
+#endif
+
+// Frames waiting for the transmitter, per unit (incl. the one on air)
+#ifndef TX_QUEUE_SIZE
+#define TX_QUEUE_SIZE 3
+#endif
+
+// Receive guard after a frame left the emitter (ms)
+#ifndef TX_GUARD_MS
+#define TX_GUARD_MS 70
+#endif
+
+// Frames to different units may be on air at the same time. Turn off if an
+// emitter also reaches the other units, frames are then sent one at a time.
+#ifndef TX_CONCURRENT
+#define TX_CONCURRENT true
+#endif
+
+// 38 KHz carrier, 50% duty cycle: the pins toggle every half period
+#define SEND_RATE_KHZ   38
+#define CARRIER_HALF_US 13
+
+// Timer1 runs from the 80 MHz APB clock, divided by 16
+#define CARRIER_TICKS   (CARRIER_HALF_US * 80 / 16)
+
+static_assert(TX_QUEUE_SIZE >= 2, "TX_QUEUE_SIZE has to leave room next to the frame on air");
+
+typedef void (*TransmitCallback)(uint8_t unit, const HvacState &state);
+
+/**
+ * Non-blocking IR transmitter, shared by all units
+ *
+ * Every unit has a channel: its emitter pin and a queue of frames with the
+ * state they carry. Frames are played back edge by edge from the timer0
+ * interrupt, so loop() keeps servicing MQTT and IR receive while frames go
+ * out. The interrupt steps every channel on air, so frames to different
+ * units are interleaved instead of waiting for each other; waiting channels
+ * are started round robin. Completion is reported from loop() via the
+ * callback.
+ *
+ * The carrier comes from a timer1 interrupt that toggles the pins of all
+ * marks on air at once through the GPIO set/clear registers. Both
+ * interrupts run from IRAM and never wait; the core's waveform API
+ * busy-waits for its own timer1 interrupt, which would never return inside
+ * the timer0 one. Timer1 is taken while sending, so analogWrite(), tone()
+ * and Servo can't be used next to the transmitter, and emitter pins have
+ * to be GPIO 0-15.
+ */
+class Transmitter {
+
+  private: struct Job {
+    Frame frame;
+    HvacState state;
+    uint32_t queuedAt;
+  };
+
+  private: struct Channel {
+    uint8_t pin = 0;
+    bool attached = false;
+    Job queue[TX_QUEUE_SIZE];
+    uint8_t head = 0;
+    uint8_t count = 0;
+    List raw;                       // frame on air
+    volatile bool active = false;
+    volatile bool done = false;
+    volatile uint16_t edge = 0;
+    uint32_t nextEdge = 0;
+    uint32_t startedAt = 0;
+    volatile uint32_t finishedAt = 0;
+  };
+
+  private: Channel channels[HVAC_UNITS];
+  private: uint8_t nextChannel = 0;
+  private: volatile uint8_t onAir = 0;
+  private: volatile uint32_t finishedAt = 0;
+#ifdef ARDUINO_ARCH_ESP8266
+  private: volatile uint32_t scheduled = 0;  // next timer0 interrupt (cycles)
+  private: volatile uint32_t carrierPins = 0;  // GPIO mask of the marks on air
+  private: volatile bool carrierHigh = false;
+  private: bool carrierOn = false;  // timer1 running
+#endif
+  private: TransmitCallback callback = NULL;
+
+  public: uint32_t sent = 0;
+  public: uint32_t replaced = 0;
+  public: uint32_t overlapped = 0;  // frames started while another was on air
+  public: uint32_t lastAirtime = 0;
+
+  private: static Transmitter *instance;
+
+  public: void begin(TransmitCallback onComplete = NULL) {
+    callback = onComplete;
+    instance = this;
+#ifdef ARDUINO_ARCH_ESP8266
+    timer0_isr_init();
+    timer1_isr_init();
+#endif
+  }
+
+  /**
+   * Assign an emitter pin to a unit
+   */
+  public: void attach(uint8_t unit, uint8_t pin) {
+#ifdef ARDUINO_ARCH_ESP8266
+    if (pin > 15) {
+      Serial.printf("[IR] Emitter pin %u of unit %u is not supported (GPIO 0-15), frames are not sent\n", pin, unit);
+      return;
+    }
+#endif
+    Channel &channel = channels[unit];
+    channel.pin = pin;
+    channel.attached = true;
+    pinMode(pin, OUTPUT);
+    digitalWrite(pin, LOW);
+  }
+
+  /**
+   * Queue a frame. If the unit's queue is full, its newest waiting frame is
+   * replaced: every frame carries the whole state, so the latest one wins.
+   */
+  public: void send(uint8_t unit, const Frame &frame, const HvacState &state) {
+    Channel &channel = channels[unit];
+    uint8_t slot;
+    if (channel.count < TX_QUEUE_SIZE) {
+      slot = (channel.head + channel.count) % TX_QUEUE_SIZE;
+      channel.count++;
+    }
+    else {
+      slot = (channel.head + channel.count - 1) % TX_QUEUE_SIZE;
+      replaced++;
+    }
+
+    channel.queue[slot].frame = frame;
+    channel.queue[slot].state = state;
+    channel.queue[slot].queuedAt = micros();
+  }
+
+  public: bool isBusy() {
+    for (uint8_t i = 0; i < HVAC_UNITS; i++)
+      if (isBusy(i))
+        return true;
+    return false;
+  }
+
+  public: bool isBusy(uint8_t unit) {
+    const Channel &channel = channels[unit];
+    return channel.active || channel.done || channel.count > 0;
+  }
+
+  /**
+   * Receive guard: block while sending and for TX_GUARD_MS after the last edge
+   */
+  public: bool receiveBlocked() {
+    if (isBusy())
+      return true;
+    return sent > 0 && micros() - finishedAt < TX_GUARD_MS * 1000UL;
+  }
+
+  /**
+   * Report finished frames and start waiting ones
+   */
+  public: void loop() {
+    for (uint8_t i = 0; i < HVAC_UNITS; i++) {
+      Channel &channel = channels[i];
+      if (!channel.done)
+        continue;
+
+      Job &job = channel.queue[channel.head];
+      lastAirtime = channel.finishedAt - channel.startedAt;
+      tracer.record(TRACE_AIRTIME, lastAirtime);
+      finishedAt = channel.finishedAt;
+      sent++;
+      channel.done = false;
+      channel.head = (channel.head + 1) % TX_QUEUE_SIZE;
+      channel.count--;
+      if (callback)
+        callback(i, job.state);
+    }
+
+#ifdef ARDUINO_ARCH_ESP8266
+    // Carrier stops with the last frame on air
+    if (carrierOn && onAir == 0) {
+      timer1_disable();
+      timer1_detachInterrupt();
+      carrierOn = false;
+    }
+#endif
+
+    // Round robin, so a busy unit does not hold back the others
+    for (uint8_t n = 0; n < HVAC_UNITS; n++) {
+      if (!TX_CONCURRENT && onAir > 0)
+        break;
+      uint8_t i = nextChannel;
+      nextChannel = (nextChannel + 1) % HVAC_UNITS;
+      Channel &channel = channels[i];
+      if (channel.attached && !channel.active && !channel.done && channel.count > 0)
+        start(channel);
+    }
+  }
+
+  private: void start(Channel &channel) {
+    // Frames are encoded when they go on air, the queue only holds frames
+    const Job &job = channel.queue[channel.head];
+    uint32_t encodeAt = micros();
+    tracer.record(TRACE_TX_WAIT, encodeAt - job.queuedAt);
+    channel.raw = frameCache.get(job.frame);
+    if (DEBUG_MODE)
+      dumpFrame(channel.raw);
+    frameFilter.noteSent(job.frame);
+    channel.startedAt = micros();
+    tracer.record(TRACE_ENCODE, channel.startedAt - encodeAt);
+    if (onAir > 0)
+      overlapped++;
+#ifdef ARDUINO_ARCH_ESP8266
+    noInterrupts();
+    channel.edge = 0;
+    channel.nextEdge = ESP.getCycleCount() + microsecondsToClockCycles(10);
+    channel.active = true;
+    bool earliest = onAir == 0 || (int32_t)(channel.nextEdge - scheduled) < 0;
+    if (onAir++ == 0)
+      timer0_attachInterrupt(onTimer);
+    if (!carrierOn) {
+      carrierOn = true;
+      timer1_attachInterrupt(onCarrier);
+      timer1_enable(TIM_DIV16, TIM_EDGE, TIM_LOOP);
+      timer1_write(CARRIER_TICKS);
+    }
+    if (earliest) {
+      scheduled = channel.nextEdge;
+      timer0_write(scheduled);
+    }
+    interrupts();
+#else
+    // No waveform interrupt on this platform, fall back to a blocking send
+    IRsend irsend(channel.pin);
+    irsend.begin();
+    irsend.sendRaw(channel.raw.data, channel.raw.counter, SEND_RATE_KHZ);
+    channel.finishedAt = micros();
+    channel.done = true;
+#endif
+  }
+
+  /**
+   * Print the timings going on air and the bits they carry
+   */
+  private: void dumpFrame(const List &raw) {
+    Serial.print("[DEBUG] Sent IR signal: ");
+    for (int i = 0; i < raw.counter; i++) {
+      Serial.print(raw.data[i]);
+      Serial.print(",");
+    }
+    Serial.println();
+
+    // Bit spaces, split where the receiver splits frames without clusters
+    // (List has no leading gap, unlike rawbuf)
+    Serial.print("[DEBUG] Sent command (BIN): ");
+    uint16_t first = HvacProtocol::HEADER_LENGTH - 1;
+    for (int i = first; i < first + FRAME_BITS * 2; i += 2)
+      Serial.print(raw.data[i] > SPACE_THRESHOLD_US ? 1 : 0);
+    Serial.println();
+    Serial.printf("[DEBUG] Frame cache: %u hits, %u misses\n", frameCache.hits, frameCache.misses);
+  }
+
+#ifdef ARDUINO_ARCH_ESP8266
+  private: static void IRAM_ATTR onTimer() {
+    instance->step();
+  }
+
+  // Same level as the timer0 interrupt, so the two never preempt each other
+  private: static void IRAM_ATTR onCarrier() {
+    Transmitter *self = instance;
+    self->carrierHigh = !self->carrierHigh;
+    if (self->carrierHigh)
+      GPOS = self->carrierPins;
+    else
+      GPOC = self->carrierPins;
+  }
+
+  /**
+   * Advance every channel whose edge is due and sleep until the next one
+   */
+  private: void IRAM_ATTR step() {
+    uint32_t now = scheduled;
+    for (;;) {
+      bool any = false;
+      uint32_t next = 0;
+      for (uint8_t i = 0; i < HVAC_UNITS; i++) {
+        Channel &channel = channels[i];
+        if (!channel.active)
+          continue;
+        if ((int32_t)(channel.nextEdge - now) <= 0)
+          stepChannel(channel);
+        if (channel.active && (!any || (int32_t)(channel.nextEdge - next) < 0)) {
+          next = channel.nextEdge;
+          any = true;
+        }
+      }
+
+      if (!any) {
+        timer0_detachInterrupt();
+        return;
+      }
+
+      // Edges of different channels closer than the interrupt latency are
+      // handled in the same run
+      if ((int32_t)(next - ESP.getCycleCount()) > (int32_t)microsecondsToClockCycles(2)) {
+        scheduled = next;
+        timer0_write(next);
+        return;
+      }
+      now = next;
+    }
+  }
+
+  // Marks are on even positions, spaces on odd ones
+  private: void IRAM_ATTR stepChannel(Channel &channel) {
+    const List &raw = channel.raw;
+    uint32_t pin = 1UL << channel.pin;
+    if (channel.edge >= raw.counter) {
+      carrierPins &= ~pin;
+      GPOC = pin;
+      channel.finishedAt = micros();
+      channel.active = false;
+      channel.done = true;
+      onAir--;
+      return;
+    }
+
+    if ((channel.edge & 1) == 0) {
+      carrierPins |= pin;
+    }
+    else {
+      carrierPins &= ~pin;
+      GPOC = pin;
+    }
+
+    channel.nextEdge += microsecondsToClockCycles(raw.data[channel.edge]);
+    channel.edge++;
+  }
+#endif
+};
+
+Transmitter *Transmitter::instance = NULL;
@@ -0,0 +1,427 @@
+#include <TimeLib.h>
+
+/**
+ * Chigo ZH/JT-03 protocol traits
+ *
+ * Everything HvacController and the shared IR code need to know about a
+ * remote family, as compile-time constants and static functions: raw
+ * timings, frame layout and the field codecs between a frame and
+ * HvacState (code book in codes.h). The controller is instantiated on the
+ * traits, so every call is resolved at compile time.
+ *
+ * Frames are a body of 16-bit words sent MSB first, one space per bit
+ * (short 0, long 1), between a header (mark, space) and a footer (mark,
+ * space, end mark).
+ */
+class ZhJt03 {
+
+  /**
+   * Frame layout
+   */
+
+  public: static constexpr uint8_t WORDS = 6;
+
+  // rawbuf index of the first bit space and entries after the last one
+  public: static constexpr uint8_t HEADER_LENGTH = 4;
+  public: static constexpr uint8_t FOOTER_LENGTH = 2;
+
+  // Raw timings of a frame: header, two per bit, footer
+  public: static constexpr uint16_t RAW_LENGTH = 2 + WORDS * 16 * 2 + 3;
+
+  // Framing timings, long (1) or short (0): the header mark, header space
+  // and first bit mark; the footer mark, footer space and end mark.
+  // Long ones are more than LONG_FACTOR times a long bit space.
+  public: static constexpr char HEADER_PATTERN[] = "110";
+  public: static constexpr char FOOTER_PATTERN[] = "010";
+  public: static constexpr uint8_t LONG_FACTOR = 2;
+
+  public: struct Frame {
+    uint16_t timer = 0;
+    uint16_t extra = 0;
+    uint16_t cmd = 0;
+    uint16_t param = 0;
+    uint16_t tempMode = 0;
+    uint16_t footer = 0;
+  };
+
+  public: static void toWords(const Frame &frame, uint16_t *words) {
+    words[0] = frame.timer;
+    words[1] = frame.extra;
+    words[2] = frame.cmd;
+    words[3] = frame.param;
+    words[4] = frame.tempMode;
+    words[5] = frame.footer;
+  }
+
+  public: static Frame fromWords(const uint16_t *words) {
+    Frame frame;
+    frame.timer = words[0];
+    frame.extra = words[1];
+    frame.cmd = words[2];
+    frame.param = words[3];
+    frame.tempMode = words[4];
+    frame.footer = words[5];
+    return frame;
+  }
+
+  /**
+   * Timings (us)
+   */
+
+  public: static constexpr uint16_t HEADER_MARK = CHIGO_HEADER_MARK;
+  public: static constexpr uint16_t HEADER_SPACE = CHIGO_HEADER_SPACE;
+  public: static constexpr uint16_t BIT_MARK = CHIGO_BIT_MARK;
+  public: static constexpr uint16_t ZERO_SPACE = CHIGO_ZERO_SPACE;
+  public: static constexpr uint16_t ONE_SPACE = CHIGO_ONE_SPACE;
+  public: static constexpr uint16_t FOOTER_MARK = CHIGO_FOOTER_MARK;
+  public: static constexpr uint16_t FOOTER_SPACE = CHIGO_FOOTER_SPACE;
+  public: static constexpr uint16_t FOOTER_END_MARK = CHIGO_FOOTER_END_MARK;
+
+  /**
+   * Commands (the button a frame stands for)
+   */
+
+  public: typedef uint16_t Command;
+
+  public: static constexpr Command CMD_POWER = CHIGO_CMD_POWER;
+  public: static constexpr Command CMD_TEMP_UP = CHIGO_CMD_TEMP_UP;
+  public: static constexpr Command CMD_TEMP_DOWN = CHIGO_CMD_TEMP_DOWN;
+  public: static constexpr Command CMD_MODE = CHIGO_CMD_MODE;
+  public: static constexpr Command CMD_SPEED = CHIGO_CMD_SPEED;
+  public: static constexpr Command CMD_SWING = CHIGO_CMD_SWING;
+  public: static constexpr Command CMD_SLEEP = CHIGO_CMD_SLEEP;
+  public: static constexpr Command CMD_AIRFLOW = CHIGO_CMD_AIRFLOW;
+
+  public: static constexpr unsigned TEMP_MIN = CHIGO_TEMP_MIN;
+  public: static constexpr unsigned TEMP_MAX = CHIGO_TEMP_MAX;
+
+  public: static bool isCommand(uint16_t cmd) {
+    switch (cmd) {
+      case CHIGO_CMD_TEMP_UP:
+      case CHIGO_CMD_TEMP_DOWN:
+      case CHIGO_CMD_MODE:
+      case CHIGO_CMD_SPEED:
+      case CHIGO_CMD_SLEEP:
+      case CHIGO_CMD_POWER:
+      case CHIGO_CMD_SWING:
+      case CHIGO_CMD_AIRFLOW:
+        return true;
+    }
+    return false;
+  }
+
+  /**
+   * Checks
+   */
+
+  public: static bool hasFooter(const Frame &frame) {
+    return frame.footer == CHIGO_FOOTER;
+  }
+
+  // Every word is a byte followed by its complement, the footer is fixed
+  public: static bool isIntact(const Frame &frame) {
+    uint16_t words[WORDS];
+    toWords(frame, words);
+    for (uint8_t i = 0; i < WORDS; i++)
+      if ((uint8_t)(words[i] >> 8) != (uint8_t)~words[i])
+        return false;
+    return hasFooter(frame);
+  }
+
+  // Intact, with a known command and temperature/mode codes (sent as is)
+  public: static bool isValid(const Frame &frame) {
+    return isIntact(frame) && isCommand(frame.cmd) &&
+      chigoLookup(temperatureTable, frame.tempMode, CHIGO_MASK_TEMP) != CHIGO_INVALID &&
+      chigoLookup(modeTable, frame.tempMode, CHIGO_MASK_MODE) != CHIGO_INVALID;
+  }
+
+  /**
+   * Build the frame of a command from the state
+   * A new timer delay starts the timer, which is stamped into the state.
+   */
+  public: static Frame encode(Command cmd, HvacState &state) {
+    Frame frame;
+
+    // Skipped unless a timer delay is set, which marks the timer started
+    frame.timer = getTimerAsCode(state);
+    frame.extra = getExtraAsCode(state.turbo(), state.hold());
+
+    frame.cmd = cmd;
+    frame.param = cmd == CHIGO_CMD_POWER ? getPowerAsParameter(state) : getCompositeSpeedAsParameter(state);
+    frame.tempMode = getTemperatureAndModeAsParameter(state.temperature(), getModeAsParameter(state.mode(), state.temperature()));
+    frame.footer = CHIGO_FOOTER;
+    return frame;
+  }
+
+  /**
+   * Apply a received frame to the state
+   */
+  public: static void decode(const Frame &frame, HvacState &state) {
+
+    // Set timer state
+    if (frame.timer != CHIGO_TIMER_SKIP) {
+
+      state.setTimerSet(getTimerStateFromCode(frame.timer, state.timerSet()));
+      state.setTimerDelay(getTimerDelayFromCode(frame.timer, state.timerDelay()));
+
+      // Add timer details if delay is new
+      if (state.timerDelay() > 0 && !state.timerSet()) {
+        state.setTimerFrom(now());
+        state.setTimerSet(true);
+      }
+
+      // Reset timer if no delay
+      if (state.timerDelay() == 0) {
+        state.setTimerFrom(0);
+        state.setTimerSet(false);
+      }
+    }
+    else {
+      state.setTimerDelay(0);
+      state.setTimerFrom(0);
+      state.setTimerSet(false);
+    }
+
+    // Set extra states
+    state.setTurbo(getTurboFromCode(frame.extra));
+    state.setHold(getHoldFromCode(frame.extra));
+
+    // Set power state
+    // assume "power on" if any other command than "power off"
+    state.setPower(true);
+    if (frame.cmd == CHIGO_CMD_POWER)
+      state.setPower(getPowerFromParameter(frame.param));
+
+    // Set mode and temperature state (always)
+    state.setMode(getModeFromParameter(frame.tempMode, state.mode()));
+    state.setTemperature(getTemperatureFromParameter(frame.tempMode, state.temperature()));
+
+    // Set air speed, air flow, swing and sleep state
+    // if command is passed
+    if (
+      frame.cmd == CHIGO_CMD_SPEED ||
+      frame.cmd == CHIGO_CMD_AIRFLOW ||
+      frame.cmd == CHIGO_CMD_SWING ||
+      frame.cmd == CHIGO_CMD_SLEEP
+      )
+    {
+      state.setAirSpeed(getSpeedFromParameter(frame.param, state.airSpeed()));
+      state.setAirFlow(getAirFlowFromParameter(frame.param));
+      state.setSleepMode(getSleepModeFromParameter(frame.param));
+      state.setSwing(getSwingFromParameter(frame.param));
+    }
+  }
+
+  /**
+   * Converters
+   */
+
+  private: static unsigned getTemperatureFromParameter(uint16_t param, unsigned temperature) {
+    uint8_t index = chigoLookup(temperatureTable, param, CHIGO_MASK_TEMP);
+    if (index == CHIGO_INVALID)
+      return temperature;
+
+    // Alternative mode codes mark 32C, which shares its code with 16C
+    uint8_t mode = chigoLookup(modeTable, param, CHIGO_MASK_MODE);
+    if (index == 0 && mode != CHIGO_INVALID && (mode & CHIGO_MODE_ALT))
+      return CHIGO_TEMP_MAX;
+
+    return CHIGO_TEMP_MIN + index;
+  }
+
+  private: static unsigned getTimerDelayFromCode(uint16_t code, unsigned timerDelay) {
+    uint8_t delay = chigoLookup(timerDelayTable, code, CHIGO_MASK_TIMER_DELAY);
+    uint8_t kind = chigoLookup(timerKindTable, code, CHIGO_MASK_TIMER_KIND);
+    if (delay == CHIGO_INVALID || kind == CHIGO_INVALID)
+      return timerDelay;
+    return (kind & CHIGO_TIMER_16h) ? delay + 16 : delay;
+  }
+
+  private: static bool getTimerStateFromCode(uint16_t code, boolean isSet) {
+    uint8_t kind = chigoLookup(timerKindTable, code, CHIGO_MASK_TIMER_KIND);
+    if (kind != CHIGO_INVALID && (kind & CHIGO_TIMER_KEEP))
+      return true;
+    return isSet;
+  }
+
+  private: static uint16_t getExtraAsCode(bool turbo = false, bool hold = false) {
+    if (turbo && hold)
+      return CHIGO_EXTRA_TURBO_HOLD;
+    else if (turbo && !hold)
+      return CHIGO_EXTRA_TURBO;
+    else if (!turbo && hold)
+      return CHIGO_EXTRA_HOLD;
+    else
+      return CHIGO_EXTRA_DEFAULT;
+  }
+
+  private: static bool getTurboFromCode(uint16_t code) {
+    uint8_t extra = chigoLookup(extraTable, code, CHIGO_MASK_EXTRA);
+    return extra != CHIGO_INVALID && (extra & CHIGO_EXTRA_TURBO_FLAG);
+  }
+
+  private: static bool getHoldFromCode(uint16_t code) {
+    uint8_t extra = chigoLookup(extraTable, code, CHIGO_MASK_EXTRA);
+    return extra != CHIGO_INVALID && (extra & CHIGO_EXTRA_HOLD_FLAG);
+  }
+
+  private: static uint16_t getPowerAsParameter(const HvacState &state) {
+    static const uint16_t powerOffCodes[3] = {
+      CHIGO_PARAM_POWEROFF_SWING_0,
+      CHIGO_PARAM_POWEROFF_SWING_1,
+      CHIGO_PARAM_POWEROFF_SWING_2
+    };
+    uint16_t param = getCompositeSpeedAsParameter(state);
+    if (!state.power()) {
+      uint16_t swingMode = powerOffCodes[state.swing() < 3 ? state.swing() : 0];
+      param = (swingMode & CHIGO_MASK_SWING) | (param & CHIGO_MASK_SPEED);
+    }
+    return param;
+  }
+
+  private: static bool getPowerFromParameter(uint16_t param) {
+    uint8_t swing = chigoLookup(swingTable, param, CHIGO_MASK_SWING);
+    return !(swing != CHIGO_INVALID && (swing & CHIGO_SWING_POWEROFF));
+  }
+
+  private: static uint16_t getModeAsParameter(Mode mode, unsigned temperature) {
+    switch (mode) {
+      case Auto:
+        return CHIGO_PARAM_MODE_AUTO;
+      case Cool:
+        if (temperature == 32)
+          return CHIGO_PARAM_MODE_COOL_ALT;
+        else
+          return CHIGO_PARAM_MODE_COOL;
+      case Dry:
+        return CHIGO_PARAM_MODE_DRY;
+      case Heat:
+        if (temperature == 32)
+          return CHIGO_PARAM_MODE_HEAT_ALT;
+        else
+          return CHIGO_PARAM_MODE_HEAT;
+      case Fan:
+        if (temperature == 32)
+          return CHIGO_PARAM_MODE_FAN_ALT;
+        else
+          return CHIGO_PARAM_MODE_FAN;
+    }
+    return CHIGO_PARAM_MODE_AUTO;
+  }
+
+  private: static Mode getModeFromParameter(uint16_t param, Mode previousMode) {
+    uint8_t mode = chigoLookup(modeTable, param, CHIGO_MASK_MODE);
+    if (mode == CHIGO_INVALID)
+      return previousMode;
+    return static_cast<Mode>(mode & CHIGO_MODE_VALUE);
+  }
+
+  private: static uint16_t getSpeedAsParameter(Speed airSpeed, bool airFlow) {
+    if (airFlow) {
+      switch (airSpeed) {
+        case Slow:
+          return CHIGO_PARAM_SPEED_AF_SLOW;
+        case Medium:
+          return CHIGO_PARAM_SPEED_AF_MEDIUM;
+        case Fast:
+          return CHIGO_PARAM_SPEED_AF_FAST;
+        case Smart:
+          return CHIGO_PARAM_SPEED_AF_SMART;
+      }
+    }
+    else {
+      switch (airSpeed) {
+        case Slow:
+          return CHIGO_PARAM_SPEED_SLOW;
+        case Medium:
+          return CHIGO_PARAM_SPEED_MEDIUM;
+        case Fast:
+          return CHIGO_PARAM_SPEED_FAST;
+        case Smart:
+          return CHIGO_PARAM_SPEED_SMART;
+      }
+    }
+    return CHIGO_PARAM_SPEED_SMART;
+  }
+
+  private: static Speed getSpeedFromParameter(uint16_t param, Speed previousSpeed) {
+    uint8_t speed = chigoLookup(speedTable, param, CHIGO_MASK_SPEED);
+    if (speed == CHIGO_INVALID)
+      return previousSpeed;
+    return static_cast<Speed>(speed & CHIGO_SPEED_VALUE);
+  }
+
+  private: static bool getAirFlowFromParameter(uint16_t param) {
+    uint8_t speed = chigoLookup(speedTable, param, CHIGO_MASK_SPEED);
+    return speed != CHIGO_INVALID && (speed & CHIGO_SPEED_AIRFLOW);
+  }
+
+  private: static uint16_t getSwingAsParameter(unsigned swing, bool sleepMode) {
+    if (sleepMode) {
+      switch (swing) {
+        case 1:
+          return CHIGO_PARAM_SWING_SLEEP_1;
+        case 2:
+          return CHIGO_PARAM_SWING_SLEEP_2;
+        default:
+          return CHIGO_PARAM_SWING_SLEEP_0;
+      }
+    }
+    else {
+      switch (swing) {
+        case 1:
+          return CHIGO_PARAM_SWING_1;
+        case 2:
+          return CHIGO_PARAM_SWING_2;
+        default:
+          return CHIGO_PARAM_SWING_0;
+      }
+    }
+  }
+
+  private: static unsigned getSwingFromParameter(uint16_t param) {
+    uint8_t swing = chigoLookup(swingTable, param, CHIGO_MASK_SWING);
+    if (swing == CHIGO_INVALID)
+      return 0;
+    return swing & CHIGO_SWING_VALUE;
+  }
+
+  // Get output parameter from swing, speed and air flow
+  private: static uint16_t getCompositeSpeedAsParameter(const HvacState &state) {
+    uint16_t airSpeedComponent = getSpeedAsParameter(state.airSpeed(), state.airFlow());
+    uint16_t swingComponent = getSwingAsParameter(state.swing(), state.sleepMode());
+    return (swingComponent & CHIGO_MASK_SWING) | (airSpeedComponent & CHIGO_MASK_SPEED);
+  }
+
+  private: static bool getSleepModeFromParameter(uint16_t param) {
+    uint8_t swing = chigoLookup(swingTable, param, CHIGO_MASK_SWING);
+    return swing != CHIGO_INVALID && (swing & CHIGO_SWING_SLEEP);
+  }
+
+  private: static uint16_t getTimerAsCode(HvacState &state) {
+    if (!state.timerSet() && state.timerDelay() == 0) {
+      // Skip timer header if delay hasn't changed
+      return CHIGO_TIMER_SKIP;
+    }
+    else if (state.timerSet() && state.timerDelay() > 0) {
+      // Use old delay header if timer was already set
+      return oldTimerDelays[state.timerDelay()];
+    }
+    else {
+      if (state.timerDelay() > 0) {
+        state.setTimerSet(true);
+        state.setTimerFrom(now());
+      }
+      else {
+        state.setTimerSet(false);
+        state.setTimerFrom(0);
+      }
+      return newTimerDelays[state.timerDelay()];
+    }
+  }
+
+  private: static uint16_t getTemperatureAndModeAsParameter(int temp, uint16_t mode) {
+    unsigned int realTempIndex = temp - CHIGO_TEMP_MIN;
+    return (temperatures[realTempIndex] & CHIGO_MASK_TEMP) | (mode & CHIGO_MASK_MODE);
+  }
+};
@@ -0,0 +1,246 @@
+/**
+ * Host stand-in for the ESP8266 Arduino core
+ *
+ * Only what the sketch and the headers in include/ use: timing, GPIO,
+ * String, Serial and the flash API of the ESP object (backed by RAM).
+ */
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+using std::min;
+using std::max;
+
+#define PROGMEM
+#define ICACHE_RAM_ATTR
+#define IRAM_ATTR
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define memcpy_P memcpy
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define DEC 10
+#define HEX 16
+#define SERIAL_8N1 0
+#define SERIAL_TX_ONLY 1
+
+// NodeMCU pin names
+#define D0 16
+#define D5 14
+#define D8 15
+
+/**
+ * Timing
+ */
+inline std::chrono::steady_clock::time_point nativeBootTime = std::chrono::steady_clock::now();
+
+inline unsigned long micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - nativeBootTime).count();
+}
+
+inline unsigned long millis() {
+  return micros() / 1000;
+}
+
+inline void delay(unsigned long ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+inline void yield() {}
+
+/**
+ * GPIO: outputs are latched, inputs read back whatever was set last
+ * (idle high, like the IR receiver output)
+ */
+inline uint8_t nativePins[32] = {
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1
+};
+
+inline void pinMode(uint8_t, uint8_t) {}
+
+inline void digitalWrite(uint8_t pin, uint8_t value) {
+  nativePins[pin & 31] = value;
+}
+
+inline int digitalRead(uint8_t pin) {
+  return nativePins[pin & 31];
+}
+
+inline long random(long max) {
+  return max > 0 ? rand() % max : 0;
+}
+
+inline long random(long min, long max) {
+  return min + random(max - min);
+}
+
+inline void randomSeed(unsigned long seed) {
+  srand(seed);
+}
+
+inline char *itoa(int value, char *buffer, int base) {
+  snprintf(buffer, 12, base == 16 ? "%x" : "%d", value);
+  return buffer;
+}
+
+/**
+ * Arduino String on top of std::string
+ */
+class String {
+  private: std::string value;
+
+  public: String() {}
+  public: String(const char *text) : value(text ? text : "") {}
+  public: String(const std::string &text) : value(text) {}
+  public: String(char c) : value(1, c) {}
+  public: String(int number, int base = DEC) : value(format(base == HEX ? "%x" : "%d", number)) {}
+  public: String(unsigned number, int base = DEC) : value(format(base == HEX ? "%x" : "%u", number)) {}
+  public: String(long number, int base = DEC) : value(format(base == HEX ? "%lx" : "%ld", number)) {}
+  public: String(unsigned long number, int base = DEC) : value(format(base == HEX ? "%lx" : "%lu", number)) {}
+
+  private: template<typename T> static std::string format(const char *pattern, T number) {
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), pattern, number);
+    return buffer;
+  }
+
+  public: const char *c_str() const { return value.c_str(); }
+  public: unsigned length() const { return value.size(); }
+  public: char charAt(unsigned i) const { return value[i]; }
+  public: void setCharAt(unsigned i, char c) { value[i] = c; }
+  public: char &operator[](unsigned i) { return value[i]; }
+  public: char operator[](unsigned i) const { return value[i]; }
+  public: bool operator==(const String &other) const { return value == other.value; }
+
+  public: bool equalsIgnoreCase(const String &other) const {
+    if (other.value.size() != value.size())
+      return false;
+    for (size_t i = 0; i < value.size(); i++)
+      if (tolower(value[i]) != tolower(other.value[i]))
+        return false;
+    return true;
+  }
+
+  public: String substring(unsigned from, unsigned to) const {
+    return String(value.substr(from, to - from));
+  }
+
+  public: String &operator+=(const String &other) {
+    value += other.value;
+    return *this;
+  }
+
+  public: friend String operator+(const String &a, const String &b) {
+    return String(a.value + b.value);
+  }
+
+  public: friend String operator+(const char *a, const String &b) {
+    return String(a) + b;
+  }
+};
+
+/**
+ * Serial: written to stdout (silence with Serial.enabled = false)
+ */
+class HardwareSerial {
+  public: bool enabled = true;
+
+  public: void begin(unsigned long, int = 0, int = 0) {}
+
+  public: void print(const char *text) { if (enabled) fputs(text, stdout); }
+  public: void print(const String &text) { print(text.c_str()); }
+  public: void print(char c) { if (enabled) fputc(c, stdout); }
+  public: void print(int number, int base = DEC) { print(String(number, base)); }
+  public: void print(unsigned number, int base = DEC) { print(String(number, base)); }
+  public: void print(long number, int base = DEC) { print(String(number, base)); }
+  public: void print(unsigned long number, int base = DEC) { print(String(number, base)); }
+
+  public: template<typename T> void println(const T &value) {
+    print(value);
+    println();
+  }
+
+  public: void println() { print("\n"); }
+
+  public: void printf(const char *format, ...) {
+    if (!enabled)
+      return;
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+  }
+
+  public: void flush() { fflush(stdout); }
+};
+
+inline HardwareSerial Serial;
+
+/**
+ * ESP object: flash API over a RAM image with NOR semantics
+ * (writes can only clear bits, erasing sets a sector to 0xFF)
+ */
+#define SPI_FLASH_SEC_SIZE 4096
+
+#ifndef NATIVE_FLASH_SECTORS
+#define NATIVE_FLASH_SECTORS 16
+#endif
+
+class EspClass {
+  public: uint8_t flash[NATIVE_FLASH_SECTORS * SPI_FLASH_SEC_SIZE];
+
+  public: EspClass() {
+    memset(flash, 0xFF, sizeof(flash));
+  }
+
+  public: bool flashRead(uint32_t address, uint32_t *data, size_t size) {
+    if (address + size > sizeof(flash))
+      return false;
+    memcpy(data, flash + address, size);
+    return true;
+  }
+
+  public: bool flashWrite(uint32_t address, const uint32_t *data, size_t size) {
+    if (address + size > sizeof(flash))
+      return false;
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i++)
+      flash[address + i] &= bytes[i];
+    return true;
+  }
+
+  public: bool flashEraseSector(uint32_t sector) {
+    if (sector >= NATIVE_FLASH_SECTORS)
+      return false;
+    memset(flash + sector * SPI_FLASH_SEC_SIZE, 0xFF, SPI_FLASH_SEC_SIZE);
+    return true;
+  }
+
+  public: uint32_t getCycleCount() {
+    return micros() * 80;
+  }
+
+  public: uint32_t getFreeHeap() { return 40000; }
+  public: uint32_t getMaxFreeBlockSize() { return 36000; }
+  public: uint8_t getHeapFragmentation() { return 10; }
+  public: uint32_t getChipId() { return 0; }
+  public: void restart() { exit(0); }
+};
+
+inline EspClass ESP;
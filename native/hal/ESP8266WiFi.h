@@ -0,0 +1,38 @@
+/**
+ * Host stand-in for ESP8266WiFi
+ * The link is up unless a test sets WiFi.linkUp = false.
+ */
+#pragma once
+#include <Arduino.h>
+
+#define WIFI_STA 1
+#define WL_IDLE_STATUS 0
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+struct IPAddress {
+  operator const char *() const { return "127.0.0.1"; }
+};
+
+class ESP8266WiFiClass {
+  public: bool linkUp = true;
+  private: bool started = false;
+
+  public: void mode(int) {}
+  public: void begin(const char *, const char *) { started = true; }
+  public: void disconnect() { started = false; }
+
+  public: int status() {
+    if (!started)
+      return WL_IDLE_STATUS;
+    return linkUp ? WL_CONNECTED : WL_DISCONNECTED;
+  }
+
+  public: IPAddress localIP() { return IPAddress(); }
+};
+
+inline ESP8266WiFiClass WiFi;
+
+class WiFiClient {
+  public: void setTimeout(unsigned long) {}
+};
@@ -0,0 +1,12 @@
+/**
+ * Host stand-in for the IRremoteESP8266 receiver types
+ * (capture is done by Receiver, see include/receiver.h)
+ */
+#pragma once
+#include <IRremoteESP8266.h>
+
+struct decode_results {
+  volatile uint16_t *rawbuf = NULL;
+  uint16_t rawlen = 0;
+  bool overflow = false;
+};
@@ -0,0 +1,8 @@
+/**
+ * Host stand-in for IRremoteESP8266 2.3.2 (receiver tick and shared types)
+ */
+#pragma once
+#include <Arduino.h>
+
+// Microseconds per raw buffer tick
+#define RAWTICK 2
@@ -0,0 +1,31 @@
+/**
+ * Host stand-in for the IRremoteESP8266 sender
+ * The last frame sent (durations in us) is kept in IRsend::last.
+ */
+#pragma once
+#include <IRremoteESP8266.h>
+
+#define IRSEND_BUFFER_SIZE 256
+
+struct SentFrame {
+  uint16_t data[IRSEND_BUFFER_SIZE];
+  uint16_t length = 0;
+  uint16_t frequency = 0;
+  uint32_t frames = 0;
+};
+
+class IRsend {
+  public: static inline SentFrame last;
+
+  public: IRsend(uint16_t) {}
+  public: void begin() {}
+
+  public: void sendRaw(const uint16_t *data, uint16_t length, uint16_t frequency) {
+    if (length > IRSEND_BUFFER_SIZE)
+      length = IRSEND_BUFFER_SIZE;
+    memcpy(last.data, data, length * sizeof(uint16_t));
+    last.length = length;
+    last.frequency = frequency;
+    last.frames++;
+  }
+};
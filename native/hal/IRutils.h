@@ -0,0 +1,9 @@
+/**
+ * Host stand-in for IRutils.h
+ */
+#pragma once
+#include <IRrecv.h>
+
+inline uint16_t getCorrectedRawLength(const decode_results *results) {
+  return results->rawlen;
+}
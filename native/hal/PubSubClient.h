@@ -0,0 +1,343 @@
+/**
+ * Host stand-in for PubSubClient 2.7
+ *
+ * Without a server (setServer not called or an empty host) there is no
+ * network: the session is up unless a test sets brokerUp = false, publishes
+ * are counted and deliver() feeds an incoming message to the callback.
+ *
+ * With a server, it speaks MQTT 3.1.1 (QoS 0) over a TCP socket to a real
+ * broker, with the limits of the library: packets up to MQTT_MAX_PACKET_SIZE,
+ * no waiting for SUBACK, incoming messages delivered from loop().
+ */
+#pragma once
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <cerrno>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#ifndef MQTT_MAX_PACKET_SIZE
+#define MQTT_MAX_PACKET_SIZE 128
+#endif
+#define MQTT_KEEPALIVE 15
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+#define MQTT_CALLBACK_SIGNATURE void (*callback)(char *, uint8_t *, unsigned int)
+
+#define MQTTCONNECT 0x10
+#define MQTTCONNACK 0x20
+#define MQTTPUBLISH 0x30
+#define MQTTSUBSCRIBE 0x82
+#define MQTTPINGREQ 0xC0
+#define MQTTDISCONNECT 0xE0
+
+// Overrides the port given to setServer() (0: keep it)
+inline uint16_t nativeMqttPort = 0;
+
+class PubSubClient {
+  private: MQTT_CALLBACK_SIGNATURE = NULL;
+  private: bool session = false;
+  private: std::string host;
+  private: uint16_t port = 0;
+  private: int fd = -1;
+  private: int status = MQTT_DISCONNECTED;
+  private: uint16_t nextId = 1;
+  private: unsigned long lastOutbound = 0;
+  private: std::vector<uint8_t> inbound;
+  private: uint8_t buffer[MQTT_MAX_PACKET_SIZE + 1];
+
+  public: bool brokerUp = true;
+  public: uint32_t published = 0;
+  public: uint32_t subscribed = 0;
+  public: uint32_t received = 0;
+  public: uint32_t oversized = 0;   // publishes over MQTT_MAX_PACKET_SIZE
+
+  public: PubSubClient() {}
+  public: PubSubClient(WiFiClient &) {}
+  public: ~PubSubClient() { drop(); }
+
+  public: PubSubClient &setServer(const char *domain, uint16_t serverPort) {
+    host = domain ? domain : "";
+    port = nativeMqttPort ? nativeMqttPort : serverPort;
+    return *this;
+  }
+
+  public: PubSubClient &setCallback(MQTT_CALLBACK_SIGNATURE) {
+    this->callback = callback;
+    return *this;
+  }
+
+  private: bool online() {
+    return !host.empty();
+  }
+
+  public: bool connect(const char *id, const char *user = NULL, const char *pass = NULL) {
+    if (!online()) {
+      session = brokerUp;
+      return session;
+    }
+
+    drop();
+    if (!openSocket()) {
+      status = MQTT_CONNECT_FAILED;
+      return false;
+    }
+
+    // CONNECT: clean session, user/password if given
+    std::vector<uint8_t> packet = {0, 4, 'M', 'Q', 'T', 'T', 4, 0x02, 0, MQTT_KEEPALIVE};
+    appendString(packet, id);
+    if (user && *user) {
+      packet[7] |= 0x80;
+      appendString(packet, user);
+      if (pass) {
+        packet[7] |= 0x40;
+        appendString(packet, pass);
+      }
+    }
+    if (!send(MQTTCONNECT, packet.data(), packet.size())) {
+      status = MQTT_CONNECTION_LOST;
+      return false;
+    }
+
+    // Wait for CONNACK
+    unsigned long start = millis();
+    while (millis() - start < MQTT_KEEPALIVE * 1000UL) {
+      pollfd p = {fd, POLLIN, 0};
+      if (poll(&p, 1, 100) > 0 && !receive())
+        break;
+      if (inbound.size() >= 4 && inbound[0] == MQTTCONNACK) {
+        uint8_t code = inbound[3];
+        inbound.erase(inbound.begin(), inbound.begin() + 4);
+        if (code != 0) {
+          status = code;
+          drop();
+          return false;
+        }
+        session = true;
+        status = MQTT_CONNECTED;
+        return true;
+      }
+    }
+
+    drop();
+    status = MQTT_CONNECTION_TIMEOUT;
+    return false;
+  }
+
+  public: bool connected() {
+    if (!online())
+      session = session && brokerUp;
+    return session;
+  }
+
+  public: int state() {
+    if (!online())
+      return connected() ? MQTT_CONNECTED : MQTT_CONNECTION_TIMEOUT;
+    return status;
+  }
+
+  /**
+   * Read incoming packets and deliver messages, keep the session alive
+   */
+  public: bool loop() {
+    if (!online())
+      return connected();
+    if (!session)
+      return false;
+
+    while (receive(MSG_DONTWAIT))
+      ;
+    if (!session)
+      return false;
+
+    while (session && inbound.size() >= 2) {
+      uint32_t length = 0;
+      uint8_t shift = 0;
+      size_t at = 1;
+      for (; at < inbound.size() && at < 5; at++) {
+        length |= (uint32_t)(inbound[at] & 0x7F) << shift;
+        shift += 7;
+        if (!(inbound[at] & 0x80))
+          break;
+      }
+      if (at >= inbound.size() || inbound.size() < at + 1 + length)
+        break;
+
+      uint8_t type = inbound[0] & 0xF0;
+      const uint8_t *body = inbound.data() + at + 1;
+      if (type == MQTTPUBLISH && length >= 2) {
+        uint16_t topicLength = (body[0] << 8) | body[1];
+        uint16_t skip = (inbound[0] & 0x06) ? 2 : 0;  // packet id of QoS > 0
+        // The library drops messages that do not fit its buffer
+        if ((uint32_t)(2 + topicLength + skip) <= length && length + at + 1 <= MQTT_MAX_PACKET_SIZE) {
+          char topic[MQTT_MAX_PACKET_SIZE];
+          memcpy(topic, body + 2, topicLength);
+          topic[topicLength] = 0;
+          unsigned payloadLength = length - 2 - topicLength - skip;
+          memcpy(buffer, body + 2 + topicLength + skip, payloadLength);
+          buffer[payloadLength] = 0;
+          received++;
+          if (callback)
+            callback(topic, buffer, payloadLength);
+        }
+      }
+      inbound.erase(inbound.begin(), inbound.begin() + at + 1 + length);
+    }
+
+    if (session && millis() - lastOutbound >= MQTT_KEEPALIVE * 1000UL / 2)
+      send(MQTTPINGREQ, NULL, 0);
+    return session;
+  }
+
+  public: bool publish(const char *topic, const char *payload, bool retained = false) {
+    return publish(topic, (const uint8_t *)payload, strlen(payload), retained);
+  }
+
+  public: bool publish(const char *topic, const uint8_t *payload, unsigned int length, bool retained = false) {
+    if (!connected())
+      return false;
+    if (!online()) {
+      published++;
+      return true;
+    }
+
+    size_t topicLength = strlen(topic);
+    if (5 + 2 + topicLength + length > MQTT_MAX_PACKET_SIZE) {
+      oversized++;
+      return false;
+    }
+    std::vector<uint8_t> packet;
+    appendString(packet, topic);
+    packet.insert(packet.end(), payload, payload + length);
+    if (!send(MQTTPUBLISH | (retained ? 1 : 0), packet.data(), packet.size()))
+      return false;
+    published++;
+    return true;
+  }
+
+  public: bool subscribe(const char *topic) {
+    subscribed++;
+    if (!online() || !connected())
+      return connected();
+
+    std::vector<uint8_t> packet = {(uint8_t)(nextId >> 8), (uint8_t)nextId};
+    nextId = nextId == 0xFFFF ? 1 : nextId + 1;
+    appendString(packet, topic);
+    packet.push_back(0);
+    return send(MQTTSUBSCRIBE, packet.data(), packet.size());
+  }
+
+  public: void disconnect() {
+    if (session && fd >= 0)
+      send(MQTTDISCONNECT, NULL, 0);
+    drop();
+    status = MQTT_DISCONNECTED;
+  }
+
+  /**
+   * Close the socket without a DISCONNECT, like a lost link
+   */
+  public: void drop() {
+    if (fd >= 0)
+      close(fd);
+    fd = -1;
+    session = false;
+    inbound.clear();
+  }
+
+  /**
+   * Hand an incoming message to the callback, as loop() would
+   */
+  public: void deliver(const char *topic, const char *payload) {
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "%s", topic);
+    if (callback)
+      callback(buffer, (uint8_t *)payload, strlen(payload));
+  }
+
+  private: bool openSocket() {
+    addrinfo hints = {};
+    addrinfo *addresses = NULL;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+      return false;
+
+    for (addrinfo *a = addresses; a && fd < 0; a = a->ai_next) {
+      fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+      if (fd >= 0 && ::connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+      }
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0)
+      return false;
+
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return true;
+  }
+
+  private: static void appendString(std::vector<uint8_t> &packet, const char *text) {
+    size_t length = strlen(text);
+    packet.push_back(length >> 8);
+    packet.push_back(length & 0xFF);
+    packet.insert(packet.end(), text, text + length);
+  }
+
+  private: bool send(uint8_t header, const uint8_t *body, size_t length) {
+    uint8_t packet[5 + 512];
+    size_t size = 0;
+    packet[size++] = header;
+    size_t remaining = length;
+    do {
+      uint8_t digit = remaining & 0x7F;
+      remaining >>= 7;
+      packet[size++] = digit | (remaining ? 0x80 : 0);
+    } while (remaining);
+    if (length > sizeof(packet) - size)
+      return false;
+    if (length)
+      memcpy(packet + size, body, length);
+    size += length;
+
+    for (size_t sent = 0; sent < size;) {
+      ssize_t n = ::send(fd, packet + sent, size - sent, MSG_NOSIGNAL);
+      if (n <= 0) {
+        lost();
+        return false;
+      }
+      sent += n;
+    }
+    lastOutbound = millis();
+    return true;
+  }
+
+  // Append what the socket has, false when nothing more is available
+  private: bool receive(int flags = 0) {
+    uint8_t chunk[512];
+    ssize_t n = recv(fd, chunk, sizeof(chunk), flags);
+    if (n > 0) {
+      inbound.insert(inbound.end(), chunk, chunk + n);
+      return true;
+    }
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+      lost();
+    return false;
+  }
+
+  private: void lost() {
+    drop();
+    status = MQTT_CONNECTION_LOST;
+  }
+};
@@ -0,0 +1,9 @@
+/**
+ * Host stand-in for TimeLib (wall clock seconds)
+ */
+#pragma once
+#include <ctime>
+
+inline time_t now() {
+  return time(NULL);
+}
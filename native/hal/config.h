@@ -0,0 +1,2 @@
+// Host builds use the sample configuration
+#include "../../include/config-sample.h"
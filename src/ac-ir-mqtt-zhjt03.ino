@@ -3,192 +3,506 @@
 #include "config.h"
 #include "codes.h"
 #include "models.h"
+#include "zhjt03.h"
+#include "protocol.h"
+#include "events.h"
+#include "trace.h"
+#include "metrics.h"
 #include "memory.h"
+#include "encoder.h"
+#include "fingerprint.h"
+#include "classifier.h"
+#include "transmitter.h"
+#include "receiver.h"
+#include "json.h"
+#include "router.h"
+#include "connection.h"
+#include "outbox.h"
+#include "corpus.h"
 #include "hvac.h"
 
-// LED light
-#ifndef LED
-#define LED           D0
+// Publish the whole state as one JSON document (<prefix>/state/get)
+// instead of one message per field
+#ifndef JSON_STATE
+#define JSON_STATE    false
 #endif
 
-HvacController hvac;
-HvacState newHvacState;
-HvacState oldHvacState;
+// Topics of a unit, after its prefix (unit_topics)
+#define TOPIC_STATE_GET           "/state/get"
+#define TOPIC_STATE_SET           "/state/set"
+#define TOPIC_POWER_GET           "/power/get"
+#define TOPIC_POWER_SET           "/power/set"
+#define TOPIC_TEMPERATURE_GET     "/temperature/get"
+#define TOPIC_TEMPERATURE_SET     "/temperature/set"
+#define TOPIC_MODE_GET            "/mode/get"
+#define TOPIC_MODE_SET            "/mode/set"
+#define TOPIC_FAN_GET             "/fan/get"
+#define TOPIC_FAN_SET             "/fan/set"
+#define TOPIC_SWING_GET           "/swing/get"
+#define TOPIC_SWING_SET           "/swing/set"
+#define TOPIC_FRAME_GET           "/frame/get"
+#define TOPIC_FRAME_SET           "/frame/set"
+
+// Units (config.h): an IR send pin and a topic prefix each
+#ifndef UNIT_SEND_PINS
+#if HVAC_UNITS > 1
+#error "List one IR send pin per unit in UNIT_SEND_PINS"
+#endif
+#define UNIT_SEND_PINS {SEND_PIN}
+#endif
+
+#if !defined(UNIT_TOPICS) && HVAC_UNITS > 1
+#error "List one MQTT topic prefix per unit in UNIT_TOPICS"
+#endif
+
+#if !defined(UNIT_TOPICS) && JSON_STATE
+#error "JSON_STATE publishes on <prefix>/state/get, set UNIT_TOPICS"
+#endif
+
+const uint8_t unit_send_pins[HVAC_UNITS] = UNIT_SEND_PINS;
+
+#ifdef UNIT_TOPICS
+const char* unit_topics[HVAC_UNITS] = UNIT_TOPICS;
+#else
+// config.h of former versions: one topic per field of a single unit. The
+// router sees them as the suffixes they stand for, after an empty prefix;
+// the state and frame topics have no such names and are left out.
+const char* unit_topics[1] = {""};
+
+struct LegacyTopic {
+  const char *suffix;
+  const char **topic;
+};
+
+const LegacyTopic legacy_topics[] = {
+  {TOPIC_POWER_GET, &topic_power_publish},
+  {TOPIC_POWER_SET, &topic_power_subscribe},
+  {TOPIC_TEMPERATURE_GET, &topic_temperature_publish},
+  {TOPIC_TEMPERATURE_SET, &topic_temperature_subscribe},
+  {TOPIC_MODE_GET, &topic_mode_publish},
+  {TOPIC_MODE_SET, &topic_mode_subscribe},
+  {TOPIC_FAN_GET, &topic_fan_publish},
+  {TOPIC_FAN_SET, &topic_fan_subscribe},
+  {TOPIC_SWING_GET, &topic_swing_publish},
+  {TOPIC_SWING_SET, &topic_swing_subscribe},
+};
+#endif
+
+static_assert(RECV_UNIT < HVAC_UNITS, "RECV_UNIT has to be one of the units");
+
+HvacController<HvacProtocol> hvac[HVAC_UNITS];
+HvacState oldHvacState[HVAC_UNITS]; // last published state
 
 // Enums for MQTT payloads
-char *ac_modes[] = {"auto","cool","dry","heat","fan_only"};
-char *fan_modes[] = {"slow","medium","fast","auto"};
-char *swing_modes[] = {"horizontal","fixed","natural"};
+const char *const ac_modes[] = {"auto","cool","dry","heat","fan_only","off"};
+const char *const fan_modes[] = {"slow","medium","fast","auto"};
+const char *const swing_modes[] = {"horizontal","fixed","natural"};
+#define MODE_OFF 5
 
 // MQTT setup
 WiFiClient espClient;
 PubSubClient client(espClient);
+Connection connection(client);
+Outbox outbox(client);
 char msg[50];
+char state_json[192];
 
-// Connect to WiFi
-void setup_wifi() {
-  delay(10);
-  Serial.print("[WIFI] Connecting to ");
-  Serial.print(ssid);
-  Serial.print("...");
-  WiFi.begin(ssid, password);
-  while (WiFi.status() != WL_CONNECTED) {
-    digitalWrite(LED, HIGH);
-    delay(500);
-    Serial.print(".");
-    digitalWrite(LED, LOW);
-  }
-  
-  randomSeed(micros());
+// Forward declarations (the sketch is also compiled as plain C++ on the host)
+void publishChanges(uint8_t unit, const HvacState &state, ChangeMask changes);
+void publishState(uint8_t unit, const HvacState &state);
 
-  Serial.print(" connected (IP: ");
-  Serial.print(WiFi.localIP());
-  Serial.println(")");
+/**
+ * MQTT handlers
+ */
+void onPowerMessage(uint8_t unit, int value) {
+  if (value)
+    hvac[unit].turnOn();
+  else
+    hvac[unit].turnOff();
 }
 
-// Callback for received MQTT messages
-void callback(char* topic, byte* payload, unsigned int length) {
-  Serial.print("[MQTT] Message arrived: [");
-  Serial.print(topic);
-  Serial.print("] ");
-  for (int i = 0; i < length; i++) {
-    Serial.print((char)payload[i]);
-  }
-  Serial.println();
+unsigned toTemperature(int value) {
+  if (value > (int)HvacProtocol::TEMP_MAX)
+    value = HvacProtocol::TEMP_MAX;
+  if (value < (int)HvacProtocol::TEMP_MIN)
+    value = HvacProtocol::TEMP_MIN;
+  return value;
+}
 
-  // Convert payload to different types
-  char message_buff[100];
-  int j;
-  for (j = 0; j<length; j++) {
-    message_buff[j] = payload[j];
-  }
-  message_buff[j] = '\0';
-  const char *p_payload = message_buff;
-  float got_float = atof(p_payload);
-  int got_int = (int)got_float;
-  bool got_bool;
-  if (got_int == 0 || got_int<0)
-    got_bool = 0;
+void onTemperatureMessage(uint8_t unit, int value) {
+  hvac[unit].setTemperatureTo(toTemperature(value));
+}
+
+void onModeMessage(uint8_t unit, int value) {
+  if (value == MODE_OFF)
+    hvac[unit].turnOff();
   else
-    got_bool = 1;
+    hvac[unit].setModeTo(static_cast<Mode>(value));
+}
 
-  // Power topic in
-  if (strcmp(topic,topic_power_subscribe)==0) {
-    if (got_bool) {
-      hvac.turnOn();
-      client.publish(topic_power_publish, "1", true);
+void onFanMessage(uint8_t unit, int value) {
+  hvac[unit].setSpeedTo(static_cast<Speed>(value));
+}
+
+void onSwingMessage(uint8_t unit, int value) {
+  hvac[unit].setSwingTo(value);
+}
+
+void onFrameMessage(uint8_t unit, const Frame &frame) {
+  if (!hvac[unit].sendFrame(frame) && DEBUG_MODE)
+    Serial.println("[MQTT] Frame rejected");
+}
+
+#define COUNT(values) (sizeof(values) / sizeof(values[0]))
+
+/**
+ * Any subset of the fields in one JSON object, e.g.
+ * {"power":true,"mode":"cool","temperature":22,"fan":"auto","turbo":true}
+ * Keys of the published state (sleep, airflow, timer) are accepted too.
+ * An unknown key or a bad value rejects the whole message.
+ */
+bool onStateMessage(uint8_t unit, const JsonObject &json) {
+  HvacState target = hvac[unit].state;
+  ChangeMask fields = 0;
+
+  for (uint8_t i = 0; i < json.size(); i++) {
+    int value;
+    bool flag;
+    if (json.keyIs(i, "power") && json.getBool(i, flag)) {
+      target.setPower(flag);
+      fields |= FIELD_POWER;
+    }
+    else if (json.keyIs(i, "mode") && json.getEnum(i, ac_modes, COUNT(ac_modes), value)) {
+      if (value == MODE_OFF) {
+        target.setPower(false);
+        fields |= FIELD_POWER;
+      }
+      else {
+        target.setMode(static_cast<Mode>(value));
+        fields |= FIELD_MODE;
+      }
+    }
+    else if (json.keyIs(i, "temperature") && json.getInt(i, value)) {
+      target.setTemperature(toTemperature(value));
+      fields |= FIELD_TEMPERATURE;
+    }
+    else if (json.keyIs(i, "fan") && json.getEnum(i, fan_modes, COUNT(fan_modes), value)) {
+      target.setAirSpeed(static_cast<Speed>(value));
+      fields |= FIELD_SPEED;
+    }
+    else if (json.keyIs(i, "swing") && json.getEnum(i, swing_modes, COUNT(swing_modes), value)) {
+      target.setSwing(value);
+      fields |= FIELD_SWING;
+    }
+    else if (json.keyIs(i, "turbo") && json.getBool(i, flag)) {
+      target.setTurbo(flag);
+      fields |= FIELD_TURBO;
     }
-    else {
-      hvac.turnOff();
-      client.publish(topic_power_publish, "0", true);
+    else if (json.keyIs(i, "hold") && json.getBool(i, flag)) {
+      target.setHold(flag);
+      fields |= FIELD_HOLD;
     }
+    else if ((json.keyIs(i, "sleepMode") || json.keyIs(i, "sleep")) && json.getBool(i, flag)) {
+      target.setSleepMode(flag);
+      fields |= FIELD_SLEEP;
+    }
+    else if ((json.keyIs(i, "airFlow") || json.keyIs(i, "airflow")) && json.getBool(i, flag)) {
+      target.setAirFlow(flag);
+      fields |= FIELD_AIRFLOW;
+    }
+    else if ((json.keyIs(i, "timerDelay") || json.keyIs(i, "timer")) && json.getInt(i, value) && value >= 0 && value <= 24) {
+      target.setTimerDelay(value);
+      fields |= FIELD_TIMER;
+    }
+    else
+      return false;
   }
 
-  // Temperature topic in
-  if (strcmp(topic,topic_temperature_subscribe)==0) {
-    if (got_int > CHIGO_TEMP_MAX)
-      got_int = CHIGO_TEMP_MAX;
-    if (got_int < CHIGO_TEMP_MIN)
-      got_int = CHIGO_TEMP_MIN;
-    hvac.setTemperatureTo(got_int);
-    client.publish(topic_temperature_publish, String(got_int).c_str(), true);
+  if (!fields)
+    return false;
+  hvac[unit].setStateTo(target, fields);
+  return true;
+}
+
+const Route routes[] = {
+  {TOPIC_POWER_SET, PAYLOAD_BOOL, NULL, 0, onPowerMessage, NULL, NULL},
+  {TOPIC_TEMPERATURE_SET, PAYLOAD_INT, NULL, 0, onTemperatureMessage, NULL, NULL},
+  {TOPIC_MODE_SET, PAYLOAD_ENUM, ac_modes, COUNT(ac_modes), onModeMessage, NULL, NULL},
+  {TOPIC_FAN_SET, PAYLOAD_ENUM, fan_modes, COUNT(fan_modes), onFanMessage, NULL, NULL},
+  {TOPIC_SWING_SET, PAYLOAD_ENUM, swing_modes, COUNT(swing_modes), onSwingMessage, NULL, NULL},
+  {TOPIC_FRAME_SET, PAYLOAD_FRAME, NULL, 0, NULL, onFrameMessage, NULL},
+  {TOPIC_STATE_SET, PAYLOAD_JSON, NULL, 0, NULL, NULL, onStateMessage},
+};
+
+Router router(routes);
+
+/**
+ * Full topic of a unit (valid until the next call), NULL if it has none
+ */
+const char* unitTopic(uint8_t unit, const char *suffix) {
+#ifdef UNIT_TOPICS
+  return router.topic(unit, suffix);
+#else
+  for (const LegacyTopic &legacy : legacy_topics)
+    if (strcmp(legacy.suffix, suffix) == 0)
+      return *legacy.topic;
+  return NULL;
+#endif
+}
+
+/**
+ * Topic as the router matches it (unit prefix and suffix), NULL if unknown
+ */
+const char* routedTopic(const char *topic) {
+#ifdef UNIT_TOPICS
+  return topic;
+#else
+  for (const LegacyTopic &legacy : legacy_topics)
+    if (strcmp(*legacy.topic, topic) == 0)
+      return legacy.suffix;
+  return NULL;
+#endif
+}
+
+/**
+ * Planned restart: write every unit's pending state first, the journal is
+ * written behind and would lose the last MEMORY_QUIET_MS of changes
+ */
+void restartNode() {
+  Serial.println("[STATUS] Restarting");
+  for (uint8_t unit = 0; unit < HVAC_UNITS; unit++)
+    hvac[unit].flushMemory();
+  client.disconnect();
+  ESP.restart();
+}
+
+#ifdef RESTART_TOPIC
+/**
+ * Remote restart, only for the payload "restart". PubSubClient does not
+ * pass the retain flag, so a retained request is cleared first; it would
+ * restart the node again on every reconnect.
+ */
+void onRestartMessage(const byte *payload, unsigned int length) {
+  if (length != 7 || memcmp(payload, "restart", 7) != 0) {
+    if (DEBUG_MODE)
+      Serial.println("[MQTT] Restart request ignored (payload has to be \"restart\")");
+    return;
   }
+  client.publish(RESTART_TOPIC, "", true);
+  restartNode();
+}
+#endif
 
-  // Mode topic in
-  if (strcmp(topic,topic_mode_subscribe)==0) {
-    for (int i=0; i<sizeof(ac_modes); i++) {
-      if (strcmp(p_payload,"off")==0) {
-        hvac.turnOff();
-        client.publish(topic_power_publish, "0", true);
-        client.publish(topic_mode_publish, "off", true);
-        break;
-      }
-      else if (strcmp(p_payload,ac_modes[i])==0) {
-        hvac.setModeTo(static_cast<Mode>(i));
-        client.publish(topic_power_publish, "1", true);
-        client.publish(topic_mode_publish, ac_modes[i], true);
-        client.publish(topic_temperature_publish, String(hvac.getTemperature()).c_str(), true);
-        break;
-      }
-    }
+// Callback for received MQTT messages
+void callback(char* topic, byte* payload, unsigned int length) {
+  if (DEBUG_MODE)
+    Serial.printf("[MQTT] Message arrived: [%s] %.*s\n", topic, length, (const char*)payload);
+
+#ifdef RESTART_TOPIC
+  if (strcmp(topic, RESTART_TOPIC) == 0) {
+    onRestartMessage(payload, length);
+    return;
   }
+#endif
 
-  // Fan topic in
-  if (strcmp(topic,topic_fan_subscribe)==0) {
-    for (int i=0; i<sizeof(fan_modes); i++) {
-      if (strcmp(p_payload,fan_modes[i])==0) {
-        hvac.setSpeedTo(static_cast<Speed>(i));
-        client.publish(topic_fan_publish, fan_modes[i], true);
-        break;
-      }
-    }
+  const char *routed = routedTopic(topic);
+  if (!routed)
+    router.rejected++;
+  if ((!routed || !router.dispatch(routed, payload, length)) && DEBUG_MODE)
+    Serial.println("[MQTT] Message rejected");
+}
+
+/**
+ * MQTT session established (again)
+ */
+void onConnected() {
+  outbox.publish(topic_handshake, "hello world");
+
+  // Publish what changed during the outage, or the last state if available
+  // (memory is written behind, so the controller holds the latest state)
+  for (uint8_t unit = 0; unit < HVAC_UNITS; unit++) {
+    if (MEMORY_MODE)
+      publishState(unit, hvac[unit].state);
+    else
+      publishChanges(unit, hvac[unit].state, diffState(hvac[unit].state, oldHvacState[unit]));
   }
 
-  // Swing topic in
-  if (strcmp(topic,topic_swing_subscribe)==0) {
-    for (int i=0; i<sizeof(swing_modes); i++) {
-      if (strcmp(p_payload,swing_modes[i])==0) {
-        hvac.setSwingTo(i);
-        client.publish(topic_swing_publish, swing_modes[i], true);
-        break;
-      }
+  // Subscribe to topics
+#ifdef RESTART_TOPIC
+  client.subscribe(RESTART_TOPIC);
+#endif
+  for (uint8_t unit = 0; unit < HVAC_UNITS; unit++)
+    for (uint8_t i = 0; i < router.size(); i++) {
+      const char *topic = unitTopic(unit, routes[i].suffix);
+      if (topic)
+        client.subscribe(topic);
     }
+}
+
+/**
+ * Serialize entire state into state_json
+ */
+const char* stateToJson(const HvacState &state) {
+  snprintf(state_json, sizeof(state_json),
+    "{\"power\":%s,\"mode\":\"%s\",\"temperature\":%u,\"fan\":\"%s\",\"swing\":\"%s\","
+    "\"turbo\":%s,\"hold\":%s,\"sleep\":%s,\"airflow\":%s,\"timer\":%u}",
+    state.power() ? "true" : "false",
+    state.mode() < 5 ? ac_modes[state.mode()] : "auto",
+    state.temperature(),
+    state.airSpeed() < 4 ? fan_modes[state.airSpeed()] : "auto",
+    state.swing() < 3 ? swing_modes[state.swing()] : "horizontal",
+    state.turbo() ? "true" : "false",
+    state.hold() ? "true" : "false",
+    state.sleepMode() ? "true" : "false",
+    state.airFlow() ? "true" : "false",
+    state.timerSet() ? state.timerDelay() : 0);
+  return state_json;
+}
+
+/**
+ * Queue a retained state message of a unit, if it has the topic
+ */
+void publishUnit(uint8_t unit, const char *suffix, const char *payload) {
+  const char *topic = unitTopic(unit, suffix);
+  if (topic)
+    outbox.publish(topic, payload, true, unit);
+}
+
+/**
+ * Publish changed fields of a unit's state to MQTT
+ */
+void publishChanges(uint8_t unit, const HvacState &state, ChangeMask changes) {
+  // Keep the changes pending while offline, onConnected() catches up
+  if (!changes || !connection.isConnected())
+    return;
+
+#if JSON_STATE
+  publishUnit(unit, TOPIC_STATE_GET, stateToJson(state));
+#else
+  char c_temp[4];
+
+  // Fix for Home Assistant MQTT HVAC: pseudo-mode "off"
+  if (changes & FIELD_POWER) {
+    publishUnit(unit, TOPIC_POWER_GET, state.power() ? "1" : "0");
+    changes |= FIELD_MODE;
   }
 
-  // Update HVAC state memory based on MQTT message
-  if (MEMORY_MODE) {
-    hvac.updateMemory();
+  if ((changes & FIELD_MODE) && state.mode() < 5)
+    publishUnit(unit, TOPIC_MODE_GET, state.power() ? ac_modes[state.mode()] : "off");
+
+  if (changes & FIELD_TEMPERATURE)
+    publishUnit(unit, TOPIC_TEMPERATURE_GET, itoa(state.temperature(), c_temp, 10));
+
+  if ((changes & FIELD_SPEED) && state.airSpeed() < 4)
+    publishUnit(unit, TOPIC_FAN_GET, fan_modes[state.airSpeed()]);
+
+  if ((changes & FIELD_SWING) && state.swing() < 3)
+    publishUnit(unit, TOPIC_SWING_GET, swing_modes[state.swing()]);
+#endif
+
+  oldHvacState[unit] = state;
+}
+
+/**
+ * Publish a received IR frame as raw bytes (<prefix>/frame/get)
+ */
+void publishFrame(uint8_t unit, const Frame &frame) {
+  const char *topic = unitTopic(unit, TOPIC_FRAME_GET);
+  if (!topic || !connection.isConnected())
+    return;
+  uint8_t bytes[FRAME_BYTES];
+  frameToBytes(frame, bytes);
+  outbox.publish(topic, bytes, FRAME_BYTES, false);
+}
+
+/**
+ * A unit's state message left the outbox
+ */
+void onSent(uint8_t unit) {
+  tracer.finishRequest(unit);
+}
+
+/**
+ * Publish the stage latency histograms, one message per stage
+ * (<DIAGNOSTICS_TOPIC>/<stage>), and start new ones; the outbox and
+ * receiver counters go to <DIAGNOSTICS_TOPIC>/outbox and /receiver
+ */
+void publishDiagnostics() {
+#ifdef DIAGNOSTICS_TOPIC
+  if (!connection.isConnected())
+    return;
+
+  char topic[MAX_TOPIC_LENGTH];
+  char payload[MAX_DIAGNOSTICS_LENGTH];
+  for (uint8_t i = 0; i < TRACE_STAGES; i++) {
+    TraceStage stage = static_cast<TraceStage>(i);
+    if (tracer.histogram(stage).count == 0)
+      continue;
+    snprintf(topic, sizeof(topic), "%s/%s", DIAGNOSTICS_TOPIC, traceStageNames[i]);
+    client.publish(topic, tracer.histogram(stage).toJson(payload, sizeof(payload)));
   }
+  snprintf(topic, sizeof(topic), "%s/outbox", DIAGNOSTICS_TOPIC);
+  client.publish(topic, outbox.toJson(payload, sizeof(payload)));
+  snprintf(topic, sizeof(topic), "%s/receiver", DIAGNOSTICS_TOPIC);
+  snprintf(payload, sizeof(payload), "{\"frames\":%lu,\"aborted\":%lu,\"overruns\":%lu,\"echoes\":%lu,\"repeats\":%lu}",
+    (unsigned long)receiver.frames, (unsigned long)receiver.aborted, (unsigned long)receiver.overruns,
+    (unsigned long)frameFilter.echoes, (unsigned long)frameFilter.repeats);
+  client.publish(topic, payload);
+#endif
+  tracer.reset();
 }
 
 /**
- * Establish MQTT connection
+ * Publish the runtime metrics (retained) and start a new period
  */
-void reconnect() {
-  // Loop until we're reconnected
-  while (!client.connected()) {
-    Serial.print("[MQTT] Connecting to ");
-    Serial.print(mqtt_server);
-    Serial.print("...");
-
-    // Attempt to connect
-    if (client.connect(clientID, mqtt_username, mqtt_password)) {
-      Serial.print(" connected");
-      client.publish(topic_handshake, "hello world");
-
-      // Publish last state if available
-      if (MEMORY_MODE) {
-        memory.read(oldHvacState);
-        publishState(oldHvacState);
-      }
+void publishMetrics() {
+  metrics.sample();
+  metrics.sampleConnection(connection.drops, connection.downtime());
+  if (DEBUG_MODE)
+    metrics.dump();
 
-      // Subscribe to topics
-      client.subscribe(topic_power_subscribe);
-      client.subscribe(topic_temperature_subscribe);
-      client.subscribe(topic_mode_subscribe);
-      client.subscribe(topic_fan_subscribe);
-      client.subscribe(topic_swing_subscribe);
-    } else {
-      Serial.print(" failed, rc=");
-      Serial.print(client.state());
-      Serial.print(" try again in 5 seconds");
-      // Wait 5 seconds before retrying
-      delay(5000);
-    }
-    Serial.println();
+#ifdef METRICS_TOPIC
+  if (connection.isConnected()) {
+    char payload[MAX_METRICS_LENGTH];
+    client.publish(METRICS_TOPIC, metrics.toJson(payload, sizeof(payload)), true);
   }
+#endif
+  metrics.reset();
+}
+
+/**
+ * Publish a unit's entire state to MQTT
+ */
+void publishState(uint8_t unit, const HvacState &state) {
+  publishChanges(unit, state, FIELD_ALL);
 }
 
 /**
- * Publish entire state to MQTT
+ * Change bus listeners
+ * Changes from set messages are published once their frame has been sent
+ * (onTransmitted), the ones from remote frames right away.
  */
-void publishState(HvacState state) {
-  char c_temp[3];
-  client.publish(topic_power_publish, newHvacState.power ? "1" : "0", true);
-  client.publish(topic_mode_publish, ac_modes[state.mode], true);
-  client.publish(topic_temperature_publish, itoa(state.temperature, c_temp, 10), true);
-  client.publish(topic_fan_publish, fan_modes[state.airSpeed], true);
-  client.publish(topic_swing_publish, swing_modes[state.swing], true);
+void onChangePublish(const StateChange &change) {
+  if (DEBUG_MODE)
+    Serial.printf("[DEBUG] Unit %u changed (%s): %08lX\n", change.unit,
+      changeSourceNames[change.source], (unsigned long)change.fields);
+  if (change.source != SOURCE_MQTT)
+    publishChanges(change.unit, change.state, change.fields);
+}
+
+void onChangePersist(const StateChange &change) {
+  hvac[change.unit].updateMemory(change.fields);
+}
+
+void onChangeCount(const StateChange &change) {
+  metrics.onChange(change);
+}
+
+/**
+ * Publish the state a frame carried once it is on the air
+ */
+void onTransmitted(uint8_t unit, const HvacState &state) {
+  publishChanges(unit, state, diffState(state, oldHvacState[unit]));
 }
 
 /**
@@ -197,64 +511,48 @@ void publishState(HvacState state) {
 void setup()
 {
   pinMode(LED, OUTPUT);
-  setup_wifi();
+  randomSeed(micros());
+  espClient.setTimeout(MQTT_CONNECT_TIMEOUT_MS);
   client.setServer(mqtt_server, 1883);
-  hvac.setup();
+  router.begin(unit_topics, HVAC_UNITS);
+
+  // Start serial connection (for logging)
+  Serial.begin(BAUD_RATE, SERIAL_8N1, SERIAL_TX_ONLY);
+  delay(1000);
+
+  // Every state change, from IR or MQTT, goes out over the change bus
+  changeBus.subscribe(onChangePublish);
+  changeBus.subscribe(onChangePersist);
+  changeBus.subscribe(onChangeCount);
+
+  // IR hardware is shared, every unit has its own emitter and state
+  receiver.begin();
+  transmitter.begin(onTransmitted);
+  for (uint8_t unit = 0; unit < HVAC_UNITS; unit++)
+    hvac[unit].setup(unit, unit_send_pins[unit]);
   Serial.println("[STATUS] Waiting for IR signals...");
   client.setCallback(callback);
+  outbox.begin(onSent);
+  connection.begin(onConnected);
 }
 
 /**
  * Main loop
  */
 void loop() {
-  if (!client.connected()) {
-    reconnect();
-  }
-  client.loop();
-
-  newHvacState = hvac.checkIR();
+  metrics.loop();
+  connection.loop();
+  for (uint8_t unit = 0; unit < HVAC_UNITS; unit++)
+    hvac[unit].loop();
+  transmitter.loop();
+  outbox.loop();
 
-  // Fix for initial abnormal values (e.g. temperature = 1073646649)
-  // Interrupt if received values are abnormal
-  if (newHvacState.temperature < CHIGO_TEMP_MIN || newHvacState.temperature > CHIGO_TEMP_MAX)
-    return;
-
-  // Check for changes in power
-  if (newHvacState.power != oldHvacState.power) {
-    client.publish(topic_power_publish, newHvacState.power ? "1" : "0", true);
-    
-    // Fix for Home Assistant MQTT HVAC
-    // set pseudo-mode "off"
-    if (!newHvacState.power)
-      client.publish(topic_mode_publish, "off", true);
-  }
-
-  // Check for changes in temperature
-  if (newHvacState.temperature != oldHvacState.temperature) {
-    char c_temp[3];
-    client.publish(topic_temperature_publish, itoa(newHvacState.temperature, c_temp, 10), true);
-  }
-
-  // Check for changes in AC mode if powered on
-  if (newHvacState.mode != oldHvacState.mode && newHvacState.power) {
-    if (newHvacState.mode < 5)
-      client.publish(topic_mode_publish, ac_modes[newHvacState.mode], true);
-  }
-
-  // Check for changes in fan speed
-  if (newHvacState.airSpeed != oldHvacState.airSpeed) {
-    if (newHvacState.airSpeed < 4)
-      client.publish(topic_fan_publish, fan_modes[newHvacState.airSpeed], true);
-  }
-
-  // Check for changes in swing mode
-  if (newHvacState.swing != oldHvacState.swing) {
-    if (newHvacState.swing < 3)
-      client.publish(topic_swing_publish, swing_modes[newHvacState.swing], true);
-  }
-  
-  // Update entire state
-  oldHvacState = newHvacState;
-}
+  if (tracer.publishDue())
+    publishDiagnostics();
+  if (metrics.publishDue())
+    publishMetrics();
 
+  // Decoded frames are announced on the change bus, and as they are
+  if (hvac[RECV_UNIT].checkIR())
+    publishFrame(RECV_UNIT, hvac[RECV_UNIT].lastFrame());
+}
\ No newline at end of file